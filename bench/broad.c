@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "util.h"
+#include "settings.h"
+#include "entities.h"
+#include "broad.h"
+#include "collide.h"
+#include "sprite.h"
+#include "assets.h"
+
+
+/*
+    Broad phase benchmark: scatters N bats & dragons over a room sized to
+    keep their density the same for every N, then times finding all
+    overlapping pairs (plus the bitmask test of each candidate pair)
+    through the broad phase, and by testing every pair.
+
+    Usage: bench_broad [MAX_N [N_ITERS]]
+
+    N goes from 10 up to MAX_N (default 100000) in powers of 10; testing
+    every pair is skipped once it would take too long.
+    Results go to stderr, so stdout (logging) can be thrown away.
+*/
+
+
+/* Room area per sprite, in actual pixels */
+#define AREA_PER_SPRITE (128 * 128)
+
+/* Largest N to test every pair for */
+#define MAX_N_ALL_PAIRS 10000
+
+struct pair_counts_t {
+    struct entities_t *entities;
+    int n_candidates;
+    int n_hits;
+};
+
+int count_pair(void *data, int entity_i, int entity_j){
+    struct pair_counts_t *counts = data;
+    counts->n_candidates++;
+    if(collide_entities(counts->entities, entity_i, entity_j))counts->n_hits++;
+    return 0;
+}
+
+int find_pairs_all(struct entities_t *entities, struct pair_counts_t *counts){
+    /* What the broad phase saves us from */
+    SDL_Rect *rects = malloc(sizeof(*rects) * entities->n);
+    if(rects == NULL)return 1;
+    for(int i = 0; i < entities->n; i++)entity_get_rect(entities, i, &rects[i]);
+    for(int i = 0; i < entities->n; i++){
+        for(int j = i + 1; j < entities->n; j++){
+            if(broad_rects_overlap(&rects[i], &rects[j]))RET_IF_NZ(count_pair(counts, i, j));
+        }
+    }
+    free(rects);
+    return 0;
+}
+
+void bench_report(const char *name, int n, int n_iters, Uint64 start, struct pair_counts_t *counts){
+    double ns = (double)(SDL_GetPerformanceCounter() - start) * 1e9 / SDL_GetPerformanceFrequency() / n_iters;
+    fprintf(stderr, "%-20s n=%-8i ns/call=%-12.0f ns/sprite=%-8.1f candidates=%-8i hits=%i\n",
+        name, n, ns, ns / n, counts->n_candidates, counts->n_hits);
+}
+
+int bench_broad(struct assets_t *assets, int n, int n_iters){
+    struct sprite_t *bat = sprite_load(assets, "data/sprites/bat.txt");
+    if(bat == NULL)return 2;
+    struct sprite_t *dragon = sprite_load(assets, "data/sprites/dragon.txt");
+    if(dragon == NULL)return 2;
+
+    /* A square room, with a sprite per AREA_PER_SPRITE */
+    int room_size = 1;
+    while((Sint64)room_size * room_size < (Sint64)n * AREA_PER_SPRITE)room_size++;
+    struct entities_t *entities = entities_create(1, 1);
+    if(entities == NULL)return 1;
+    RET_IF_NZ(entities_reserve(entities, n));
+    unsigned int seed = 0;
+    for(int i = 0; i < n; i++){
+        /* Numerical Recipes LCG, as in scene_spawn_sprites */
+        seed = seed * 1664525u + 1013904223u;
+        int x = (int)((seed >> 8) % (unsigned int)room_size);
+        seed = seed * 1664525u + 1013904223u;
+        int y = (int)((seed >> 8) % (unsigned int)room_size);
+        struct sprite_t *sprite = i % 6 == 5? dragon: bat;
+        RET_IF_NZ(entities_add(entities, assets, sprite, 0, 0, x, y, true, NULL));
+    }
+    struct entity_bucket_t *bucket = entities_get_bucket(entities, 0, 0);
+
+    struct broad_t *broad = broad_create();
+    if(broad == NULL)return 1;
+    struct pair_counts_t counts = {entities, 0, 0};
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(int i = 0; i < n_iters; i++){
+        RET_IF_NZ(broad_build(broad, entities, bucket->entity_i, bucket->n, room_size, room_size));
+    }
+    bench_report("broad_build", n, n_iters, start, &counts);
+
+    start = SDL_GetPerformanceCounter();
+    for(int i = 0; i < n_iters; i++){
+        counts.n_candidates = 0;
+        counts.n_hits = 0;
+        RET_IF_NZ(broad_build(broad, entities, bucket->entity_i, bucket->n, room_size, room_size));
+        RET_IF_NZ(broad_pairs(broad, count_pair, &counts));
+    }
+    bench_report("broad_pairs", n, n_iters, start, &counts);
+
+    if(n <= MAX_N_ALL_PAIRS){
+        int n_iters_all = n_iters / n + 1;
+        start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < n_iters_all; i++){
+            counts.n_candidates = 0;
+            counts.n_hits = 0;
+            RET_IF_NZ(find_pairs_all(entities, &counts));
+        }
+        bench_report("all pairs", n, n_iters_all, start, &counts);
+    }
+
+    broad_destroy(broad);
+    entities_destroy(entities, assets);
+    sprite_destroy(bat, assets);
+    sprite_destroy(dragon, assets);
+    return 0;
+}
+
+int main(int n_args, char *args[]){
+    int max_n = n_args >= 2? atoi(args[1]): 100000;
+    int n_iters = n_args >= 3? atoi(args[2]): 100;
+    int e = 0;
+    log_start();
+
+    struct assets_t *assets = assets_create();
+    if(assets == NULL || assets_use_pack(assets, PACK_FNAME)){
+        e = 1;
+    }else{
+        fprintf(stderr, "cell_size=%i area_per_sprite=%i\n", BROAD_CELL_SIZE, AREA_PER_SPRITE);
+        for(int n = 10; n <= max_n && !e; n *= 10){
+            /* Roughly the same total work for each n */
+            int n_iters_n = (int)((Sint64)n_iters * 1000 / n);
+            if(n_iters_n < 1)n_iters_n = 1;
+            e = bench_broad(assets, n, n_iters_n);
+        }
+    }
+
+    log_stop();
+    fprintf(stderr, "Exiting with code: %i\n", e);
+    return e;
+}
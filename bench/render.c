@@ -0,0 +1,227 @@
+#define RENDER_STATS 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "util.h"
+#include "settings.h"
+#include "stats.h"
+#include "world.h"
+#include "map.h"
+#include "sprite.h"
+#include "scene.h"
+#include "assets.h"
+
+
+/*
+    Render microbenchmarks: times tile, room, sprite and world rendering
+    in isolation, using SDL's software renderer on an offscreen surface
+    (so no window, and no video driver needed).
+
+    Usage: bench_render [N_ITERS [SCENE_FNAME]]
+
+    For each case, reports time, draw calls and pixels touched per call.
+    Results go to stderr, so stdout (logging) can be thrown away.
+*/
+
+
+/* Tilesets to bench tile rendering with, one per tile shape in data/ */
+const char *TILESET_FNAMES[] = {
+    "data/tileset0.txt",
+    "data/tilesets/player.txt",
+    "data/tilesets/bat.txt",
+    "data/tilesets/dragon.txt",
+    NULL
+};
+
+
+struct bench_t {
+    const char *name;
+    const char *shape;
+    int n_iters;
+    Uint64 start;
+};
+
+void bench_start(struct bench_t *bench, const char *name, const char *shape, int n_iters){
+    bench->name = name;
+    bench->shape = shape;
+    bench->n_iters = n_iters;
+    render_stats.draw_calls = 0;
+    render_stats.pixels = 0;
+    bench->start = SDL_GetPerformanceCounter();
+}
+
+void bench_end(struct bench_t *bench){
+    Uint64 end = SDL_GetPerformanceCounter();
+    double ns = (double)(end - bench->start) * 1e9 / SDL_GetPerformanceFrequency();
+    int n = bench->n_iters;
+    fprintf(stderr, "%-32s %-12s ns/call=%-10.0f calls/call=%-8.1f pixels/call=%.0f\n",
+        bench->name, bench->shape, ns / n,
+        (double)render_stats.draw_calls / n, (double)render_stats.pixels / n);
+}
+
+int bench_tiles(struct tileset_t *tileset, struct pal_t *pal, int n_iters, SDL_Renderer *renderer,
+    struct draw_batch_t *batch, struct framebuffer_t *fb
+){
+    struct bench_t bench;
+    char shape[32];
+    snprintf(shape, sizeof(shape), "%ix%i", tileset->tile_w, tileset->tile_h);
+    int tile_w = tileset->tile_w;
+    int tile_h = tileset->tile_h;
+
+    bench_start(&bench, "tile_render", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        struct tile_t *tile = &tileset->tiles[i % tileset->len];
+        RET_IF_NZ(tile_render(tile, tile_w, tile_h, 0, 0, pal, renderer));
+    }
+    bench_end(&bench);
+
+    bench_start(&bench, "tile_render_batch", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        struct tile_t *tile = &tileset->tiles[i % tileset->len];
+        RET_IF_NZ(tile_render_batch(tile, tile_w, tile_h, 0, 0, pal, batch, renderer));
+        RET_IF_NZ(draw_batch_flush(batch, renderer));
+    }
+    bench_end(&bench);
+
+    /* Built outside the timed loop */
+    if(tileset_get_cache(tileset, pal, renderer) == NULL)return 1;
+    bench_start(&bench, "tileset_render_tile", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        RET_IF_NZ(tileset_render_tile(tileset, i % tileset->len, 0, 0, pal, renderer, NULL));
+    }
+    bench_end(&bench);
+
+    bench_start(&bench, "framebuffer_render_tile", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        struct tile_t *tile = &tileset->tiles[i % tileset->len];
+        framebuffer_render_tile(fb, tile, tile_w, tile_h, 0, 0, pal);
+    }
+    bench_end(&bench);
+
+    return 0;
+}
+
+int bench_world(struct world_t *world, int n_iters, SDL_Renderer *renderer, struct framebuffer_t *fb){
+    struct bench_t bench;
+    struct room_t *room = world->room;
+    struct draw_batch_t *batch = world->batch;
+    char shape[32];
+    snprintf(shape, sizeof(shape), "%ix%i", room->w, room->h);
+
+    batch->force_rects = true;
+    bench_start(&bench, "room_render (rects)", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        RET_IF_NZ(room_render(room, 0, 0, renderer, batch));
+        RET_IF_NZ(draw_batch_flush(batch, renderer));
+    }
+    bench_end(&bench);
+    batch->force_rects = false;
+
+    bench_start(&bench, "room_render (tile cache)", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        RET_IF_NZ(room_render(room, 0, 0, renderer, NULL));
+    }
+    bench_end(&bench);
+
+    RET_IF_NZ(room_render_layer(room, 0, 0, renderer, NULL));
+    bench_start(&bench, "room_render_layer", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        RET_IF_NZ(room_render_layer(room, 0, 0, renderer, NULL));
+    }
+    bench_end(&bench);
+
+    bench_start(&bench, "room_render_framebuffer", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        room_render_framebuffer(room, 0, 0, fb);
+    }
+    bench_end(&bench);
+
+    /* Sprites: each iteration renders every entity in the room */
+    struct entities_t *entities = world->entities;
+    struct entity_bucket_t *bucket = world_get_bucket(world);
+    snprintf(shape, sizeof(shape), "%i sprites", bucket->n);
+    bench_start(&bench, "entity_render", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        for(int j = 0; j < bucket->n; j++){
+            RET_IF_NZ(entity_render(entities, bucket->entity_i[j], 0, 0, room->pal, renderer, NULL));
+        }
+    }
+    bench_end(&bench);
+
+    /* Whole world, in each render mode */
+    const char *mode_names[] = {"rects", "textures", "framebuffer"};
+    for(int mode = RENDER_MODE_RECTS; mode <= RENDER_MODE_FRAMEBUFFER; mode++){
+        char name[64];
+        snprintf(name, sizeof(name), "world_render (%s)", mode_names[mode]);
+        world->render_mode = mode;
+        world->dirty_all = true;
+        bench_start(&bench, name, shape, n_iters);
+        for(int i = 0; i < n_iters; i++){
+            /* Nothing moves, so in framebuffer mode that's a full redraw
+            followed by n_iters - 1 clean frames */
+            RET_IF_NZ(world_render(world, 0, 0, renderer));
+        }
+        bench_end(&bench);
+    }
+
+    bench_start(&bench, "world_render (framebuffer, full)", shape, n_iters);
+    for(int i = 0; i < n_iters; i++){
+        world->dirty_all = true;
+        RET_IF_NZ(world_render(world, 0, 0, renderer));
+    }
+    bench_end(&bench);
+
+    return 0;
+}
+
+int bench_render(int n_iters, const char *scene_fname, SDL_Renderer *renderer){
+    struct assets_t *assets = assets_create();
+    if(assets == NULL)return 1;
+    RET_IF_NZ(assets_use_pack(assets, PACK_FNAME));
+    struct world_t *world = scene_load(assets, scene_fname);
+    if(world == NULL)return 1;
+    struct pal_t *pal = world->room->pal;
+
+    struct draw_batch_t *batch = draw_batch_create(true);
+    if(batch == NULL)return 1;
+    struct framebuffer_t *fb = framebuffer_create(SCW, SCH);
+    if(fb == NULL)return 1;
+
+    fprintf(stderr, "Renderer: software, %ix%i, %i iterations\n", SCW, SCH, n_iters);
+    for(int i = 0; TILESET_FNAMES[i] != NULL; i++){
+        struct tileset_t *tileset = tileset_acquire(assets, TILESET_FNAMES[i]);
+        if(tileset == NULL)return 1;
+        RET_IF_NZ(bench_tiles(tileset, pal, n_iters, renderer, batch, fb));
+    }
+    RET_IF_NZ(bench_world(world, n_iters, renderer, fb));
+    return 0;
+}
+
+int main(int n_args, char *args[]){
+    int n_iters = n_args >= 2? atoi(args[1]): 1000;
+    const char *scene_fname = n_args >= 3? args[2]: "data/scenes/mixed.txt";
+    int e = 0;
+    log_start();
+
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, SCW, SCH, 32, SDL_PIXELFORMAT_ARGB8888);
+    if(!surface){
+        e = 1;
+        fprintf(stderr, "SDL_CreateRGBSurfaceWithFormat error: %s\n", SDL_GetError());
+    }else{
+        SDL_Renderer *renderer = SDL_CreateSoftwareRenderer(surface);
+        if(!renderer){
+            e = 1;
+            fprintf(stderr, "SDL_CreateSoftwareRenderer error: %s\n", SDL_GetError());
+        }else{
+            e = bench_render(n_iters, scene_fname, renderer);
+            SDL_DestroyRenderer(renderer);
+        }
+        SDL_FreeSurface(surface);
+    }
+    log_stop();
+    fprintf(stderr, "Exiting with code: %i\n", e);
+    return e;
+}
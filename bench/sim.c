@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "util.h"
+#include "settings.h"
+#include "world.h"
+#include "map.h"
+#include "sprite.h"
+#include "scene.h"
+#include "assets.h"
+#include "replay.h"
+
+
+/*
+    Headless simulation benchmark: loads a scene, then runs the world's
+    ticks as fast as possible with scripted input, without a window
+    (or even initializing SDL's video subsystem). CPU sprites in the
+    current room chase the players (see flow.h), so scripted input only
+    moves the players, & CPU sprites elsewhere.
+
+    Usage: bench_sim [SCENE_FNAME [N_TICKS [LOAD_THREADS [REPLAY_FNAME [TICK_THREADS]]]]]
+
+    LOAD_THREADS & TICK_THREADS default to the settings of the same
+    names, so e.g. -1 loads the scene (or ticks) on this thread only (see
+    assets_use_jobs, world_use_jobs). The scenes in data/scenes/stress*
+    are for seeing how ticks scale with TICK_THREADS.
+
+    With REPLAY_FNAME (other than "-"), an input log recorded by playing SCENE_FNAME (see
+    main.c) replaces the scripted input of its sprites, and the
+    benchmark stops after N_TICKS or the log's last tick, whichever comes
+    first. Everything else is still scripted; non-CPU sprites are only
+    what's in the log.
+
+    Then times dispatching key events (see world_handle_key), which should
+    cost the same whatever the number of sprites.
+
+    Results go to stderr, so stdout (logging) can be thrown away.
+*/
+
+
+void script_controller(struct entities_t *entities, int i, int tick){
+    /* Holds a "random" direction for 16 ticks at a time, different for
+    each entity, and taps KEY_DROP now and then */
+    unsigned int h = (unsigned int)(tick / 16) * 2654435761u ^ (unsigned int)i * 40503u;
+    h ^= h >> 13;
+    Uint8 keys = 0;
+    switch(h % 5){
+        case 0: keys = KEY_BIT(KEY_U); break;
+        case 1: keys = KEY_BIT(KEY_D); break;
+        case 2: keys = KEY_BIT(KEY_L); break;
+        case 3: keys = KEY_BIT(KEY_R); break;
+        default: break;
+    }
+    if(tick % 64 == i % 64)keys |= KEY_BIT(KEY_DROP);
+    entities->key_is_down[i] = keys;
+    entities->key_was_down[i] |= keys;
+}
+
+int bench_sim(struct world_t *world, int n_ticks, struct replay_reader_t *replay){
+    struct entities_t *entities = world->entities;
+    int n_sprites = entities->n;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(int tick = 0; tick < n_ticks; tick++){
+        RET_IF_NZ(world_prepare_tick(world));
+        if(replay != NULL){
+            if(replay_reader_is_done(replay)){
+                n_ticks = tick;
+                break;
+            }
+            for(int i = 0; i < entities->n; i++){
+                if(entities->controller[i].is_cpu)script_controller(entities, i, tick);
+            }
+            RET_IF_NZ(replay_reader_play(replay, entities));
+        }else{
+            for(int i = 0; i < entities->n; i++)script_controller(entities, i, tick);
+        }
+        RET_IF_NZ(world_do_tick(world));
+    }
+    Uint64 end = SDL_GetPerformanceCounter();
+
+    double secs = (double)(end - start) / SDL_GetPerformanceFrequency();
+    fprintf(stderr, "sprites=%i ticks=%i tick_threads=%i secs=%.3f ticks/sec=%.1f ns/tick=%.0f\n",
+        n_sprites, n_ticks, world->jobs == NULL? 0: world->jobs->n_threads,
+        secs, n_ticks / secs, secs * 1e9 / n_ticks);
+    return 0;
+}
+
+int bench_keys(struct world_t *world, int n_events){
+    /* Binds the arrow keys to the first entity, then presses & releases
+    them n_events times */
+    struct entities_t *entities = world->entities;
+    if(entities->n == 0)return 0;
+    SDL_Keycode keycodes[KEYS] = {
+        SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT,
+        SDLK_SPACE
+    };
+    RET_IF_NZ(entities_set_keycodes(entities, entities_get_entity(entities, 0), keycodes));
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(int k = 0; k < n_events; k++){
+        world_handle_key(world, keycodes[k % KEYS], k % (KEYS * 2) < KEYS);
+    }
+    Uint64 end = SDL_GetPerformanceCounter();
+
+    double secs = (double)(end - start) / SDL_GetPerformanceFrequency();
+    fprintf(stderr, "sprites=%i key_events=%i ns/event=%.1f\n",
+        entities->n, n_events, secs * 1e9 / n_events);
+    return 0;
+}
+
+int main(int n_args, char *args[]){
+    const char *scene_fname = n_args >= 2? args[1]: "data/scenes/bats.txt";
+    int n_ticks = n_args >= 3? atoi(args[2]): 1000;
+    int load_threads = n_args >= 4? atoi(args[3]): LOAD_THREADS;
+    const char *replay_fname = n_args >= 5 && strcmp(args[4], "-") != 0? args[4]: NULL;
+    int tick_threads = n_args >= 6? atoi(args[5]): TICK_THREADS;
+    log_start();
+
+    struct replay_reader_t *replay = NULL;
+    if(replay_fname != NULL){
+        replay = replay_reader_load(replay_fname);
+        if(replay == NULL || strcmp(replay->scene_fname, scene_fname) != 0){
+            fprintf(stderr, "Couldn't replay %s on scene %s (recorded on: %s)\n", replay_fname, scene_fname,
+                replay == NULL? "?": replay->scene_fname);
+            log_stop();
+            return 1;
+        }
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    struct assets_t *assets = assets_create();
+    struct world_t *world = NULL;
+    if(assets != NULL && assets_use_pack(assets, PACK_FNAME) == 0 &&
+        assets_use_jobs(assets, load_threads) == 0
+    ){
+        world = scene_load(assets, scene_fname);
+    }
+    if(world == NULL || world_use_jobs(world, tick_threads)){
+        log_stop();
+        return 1;
+    }
+
+    double load_secs = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    fprintf(stderr, "scene=%s pack=%s load_threads=%i load_secs=%.4f\n", scene_fname,
+        assets->pack == NULL? "none": assets->pack->fname,
+        assets->jobs == NULL? 0: assets->jobs->n_threads, load_secs);
+
+    int e = bench_sim(world, n_ticks, replay);
+    if(e == 0)e = bench_keys(world, 1000000);
+    log_stop();
+    fprintf(stderr, "Exiting with code: %i\n", e);
+    return e;
+}
@@ -0,0 +1,348 @@
+#ifndef _ASSETS_H_
+#define _ASSETS_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+#include "pack.h"
+#include "jobs.h"
+
+
+/*
+    Registry of loaded assets (palettes, tilesets, rooms), keyed by type
+    and canonical path, so that each file gets loaded once however many
+    things refer to it.
+
+    assets_acquire returns the already-loaded copy of a file if there is
+    one, otherwise loads it; either way, the caller gets a reference,
+    which it gives back with assets_release. When an asset's last
+    reference is released, it's destroyed.
+
+    Since assets are shared, modifying one (e.g. room_touch) affects
+    everything referring to it.
+
+    If the registry has a pack (see assets_use_pack), loaders look for
+    their file in it first, and only parse the text file if it's not
+    there.
+
+    The registry may be used from several threads at once (see
+    assets_use_jobs). If two threads acquire the same file, one loads it
+    while the other waits for it.
+*/
+
+
+enum asset_type_e {
+    ASSET_PAL,
+    ASSET_TILESET,
+    ASSET_ROOM,
+
+    /* Only found in packs: maps & sprites aren't shared, so they're never
+    in the registry itself */
+    ASSET_MAP,
+    ASSET_SPRITE,
+
+    ASSET_TYPES
+};
+
+struct assets_t;
+
+/* Loads fname, returning NULL on error. Anything it depends on should be
+acquired through assets. */
+typedef void *asset_load_t(struct assets_t *assets, const char *fname);
+
+/* Frees data, releasing anything it acquired while being loaded */
+typedef void asset_destroy_t(struct assets_t *assets, void *data);
+
+struct asset_t {
+    int type;
+
+    /* canonical path, see assets_canonical_path; also passed as fname to
+    the loader, so the asset can keep it */
+    char *path;
+
+    /* NULL while loading */
+    void *data;
+    int refcount;
+    asset_destroy_t *destroy;
+
+    struct asset_t *next;
+};
+
+struct assets_t {
+    /* linked list of loaded assets */
+    struct asset_t *assets;
+
+    /* stats: files actually loaded vs. requests served from the registry */
+    int n_loads;
+    int n_hits;
+
+    /* NULL unless assets_use_pack found one */
+    struct pack_t *pack;
+
+    /* NULL unless assets_use_jobs was called, in which case loaders may
+    use it to load their dependencies in parallel */
+    struct job_pool_t *jobs;
+
+    /* guards the list of assets & the stats */
+    SDL_mutex *mutex;
+
+    /* signalled whenever an asset finishes loading (or fails to) */
+    SDL_cond *loaded_cond;
+};
+
+
+
+/**********
+ * ASSETS *
+ **********/
+
+struct assets_t *assets_create(){
+    struct assets_t *assets = malloc(sizeof(*assets));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating assets: %p\n", assets);
+    }
+    if(assets == NULL)return NULL;
+    assets->assets = NULL;
+    assets->n_loads = 0;
+    assets->n_hits = 0;
+    assets->pack = NULL;
+    assets->jobs = NULL;
+    assets->mutex = SDL_CreateMutex();
+    assets->loaded_cond = SDL_CreateCond();
+    if(assets->mutex == NULL || assets->loaded_cond == NULL){
+        LOG("Couldn't create assets' mutex: %s\n", SDL_GetError());
+        return NULL;
+    }
+    return assets;
+}
+
+char *assets_canonical_path(const char *fname){
+    /* Returns a newly allocated, normalized copy of fname: backslashes
+    become slashes, and empty, "." and (where possible) ".." components
+    are removed, so e.g. "data/./x/../room0.txt" and "data//room0.txt"
+    both become "data/room0.txt".
+    This is purely textual, so symlinks aren't resolved. */
+    int len = strlen(fname);
+
+    /* Every component gets a trailing slash while we build it, so we may
+    need one more char than fname, plus the NUL */
+    char *path = malloc(len + 2);
+    if(path == NULL)return NULL;
+
+    bool absolute = fname[0] == '/' || fname[0] == '\\';
+    int path_len = 0;
+    if(absolute)path[path_len++] = '/';
+
+    /* Length of path's leading "../" components, which a later ".." can't
+    remove */
+    int fixed_len = path_len;
+
+    int i = 0;
+    while(i < len){
+        int start = i;
+        while(i < len && fname[i] != '/' && fname[i] != '\\')i++;
+        int comp_len = i - start;
+        i++;
+
+        if(comp_len == 0 || (comp_len == 1 && fname[start] == '.'))continue;
+        if(comp_len == 2 && fname[start] == '.' && fname[start + 1] == '.'){
+            if(path_len > fixed_len){
+                /* Remove the last component (and its slash) */
+                path_len--;
+                while(path_len > fixed_len && path[path_len - 1] != '/')path_len--;
+                continue;
+            }else if(absolute){
+                /* "/.." is "/" */
+                continue;
+            }
+        }
+
+        memcpy(path + path_len, fname + start, comp_len);
+        path_len += comp_len;
+        path[path_len++] = '/';
+        if(comp_len == 2 && fname[start] == '.' && fname[start + 1] == '.'){
+            fixed_len = path_len;
+        }
+    }
+
+    /* Drop the trailing slash, unless that's all there is */
+    if(path_len > 1 && path[path_len - 1] == '/')path_len--;
+    if(path_len == 0)path[path_len++] = '.';
+    path[path_len] = '\0';
+    return path;
+}
+
+int assets_use_pack(struct assets_t *assets, const char *fname){
+    /* Makes loaders use the pack at fname, if there is one. If there
+    isn't, that's fine, we just stick to the text files. */
+    FILE *f = fopen(fname, "rb");
+    if(f == NULL){
+        if(DEBUG_CREATE >= 1){
+            LOG("No pack, loading from text files: fname=%s\n", fname);
+        }
+        return 0;
+    }
+    fclose(f);
+
+    struct pack_t *pack = pack_load(fname);
+    if(pack == NULL)return 2;
+    assets->pack = pack;
+    return 0;
+}
+
+int assets_use_jobs(struct assets_t *assets, int n_threads){
+    /* Lets loaders spread their work over n_threads worker threads (0 for
+    one per core, -1 for none), see job_pool_create */
+    if(n_threads < 0)return 0;
+    struct job_pool_t *jobs = job_pool_create(n_threads);
+    if(jobs == NULL)return 2;
+    assets->jobs = jobs;
+    return 0;
+}
+
+struct pack_entry_t *assets_find_packed(struct assets_t *assets, int type, const char *fname){
+    /* Returns the pack entry for fname, or NULL if we have no pack or it
+    doesn't have fname */
+    if(assets->pack == NULL)return NULL;
+    char *path = assets_canonical_path(fname);
+    if(path == NULL)return NULL;
+    struct pack_entry_t *entry = pack_find(assets->pack, type, path);
+    free(path);
+    return entry;
+}
+
+void *assets_acquire(struct assets_t *assets, int type, const char *fname,
+    asset_load_t *load, asset_destroy_t *destroy
+){
+    /* Returns a reference to the asset of the given type loaded from fname,
+    calling load if it isn't loaded yet. Returns NULL on error. */
+    char *path = assets_canonical_path(fname);
+    if(path == NULL)return NULL;
+
+    SDL_LockMutex(assets->mutex);
+    struct asset_t *asset = assets->assets;
+    while(asset != NULL){
+        if(asset->type == type && strcmp(asset->path, path) == 0){
+            if(asset->data == NULL){
+                /* Another thread is loading it; wait, then look again,
+                since it may have failed (and been removed) */
+                SDL_CondWait(assets->loaded_cond, assets->mutex);
+                asset = assets->assets;
+                continue;
+            }
+            free(path);
+            asset->refcount++;
+            assets->n_hits++;
+            SDL_UnlockMutex(assets->mutex);
+            return asset->data;
+        }
+        asset = asset->next;
+    }
+
+    asset = malloc(sizeof(*asset));
+    if(asset == NULL){
+        SDL_UnlockMutex(assets->mutex);
+        free(path);
+        return NULL;
+    }
+
+    /* Claim the path, so that other threads wait for us rather than
+    loading it too */
+    asset->type = type;
+    asset->path = path;
+    asset->data = NULL;
+    asset->refcount = 1;
+    asset->destroy = destroy;
+    asset->next = assets->assets;
+    assets->assets = asset;
+
+    /* Unlocked while loading: load may acquire other assets, and other
+    threads may want to acquire unrelated ones meanwhile */
+    SDL_UnlockMutex(assets->mutex);
+    void *data = load(assets, path);
+    SDL_LockMutex(assets->mutex);
+
+    if(data == NULL){
+        LOG("Couldn't load asset: type=%i, path=%s\n", type, path);
+        struct asset_t **prev = &assets->assets;
+        while(*prev != asset)prev = &(*prev)->next;
+        *prev = asset->next;
+        free(asset);
+        free(path);
+    }else{
+        asset->data = data;
+        assets->n_loads++;
+    }
+    SDL_CondBroadcast(assets->loaded_cond);
+    SDL_UnlockMutex(assets->mutex);
+    return data;
+}
+
+int assets_retain(struct assets_t *assets, void *data){
+    /* Takes another reference to an already-acquired asset, e.g. when
+    copying something which refers to it */
+    SDL_LockMutex(assets->mutex);
+    for(struct asset_t *asset = assets->assets; asset != NULL; asset = asset->next){
+        if(asset->data == data){
+            asset->refcount++;
+            SDL_UnlockMutex(assets->mutex);
+            return 0;
+        }
+    }
+    SDL_UnlockMutex(assets->mutex);
+    LOG("Tried to retain an unknown asset: %p\n", data);
+    return 2;
+}
+
+int assets_release(struct assets_t *assets, void *data){
+    /* Gives back a reference to an asset, destroying it if that was the
+    last one */
+    SDL_LockMutex(assets->mutex);
+    struct asset_t **prev = &assets->assets;
+    for(struct asset_t *asset = assets->assets; asset != NULL; asset = asset->next){
+        if(asset->data == data){
+            if(--asset->refcount > 0){
+                SDL_UnlockMutex(assets->mutex);
+                return 0;
+            }
+            if(DEBUG_CREATE >= 1){
+                LOG("Destroying asset: %p, type=%i, path=%s\n", data, asset->type, asset->path);
+            }
+
+            /* Unlink first, and unlock: destroy may release other assets */
+            *prev = asset->next;
+            SDL_UnlockMutex(assets->mutex);
+            asset->destroy(assets, data);
+            free(asset->path);
+            free(asset);
+            return 0;
+        }
+        prev = &asset->next;
+    }
+    SDL_UnlockMutex(assets->mutex);
+    LOG("Tried to release an unknown asset: %p\n", data);
+    return 2;
+}
+
+void assets_repr(struct assets_t *assets, int depth){
+    if(DEBUG_REPR >= 1){
+        LOG("Dumping assets: %p\n", assets);
+    }
+    REPR_FIELD(assets, n_loads, "%i", depth)
+    REPR_FIELD(assets, n_hits, "%i", depth)
+    REPR_FIELD_MULTI(assets, depth)
+    SDL_LockMutex(assets->mutex);
+    for(struct asset_t *asset = assets->assets; asset != NULL; asset = asset->next){
+        print_tabs(depth + 1);
+        LOG_RAW("%s (type=%i, refcount=%i)\n", asset->path, asset->type, asset->refcount);
+    }
+    SDL_UnlockMutex(assets->mutex);
+}
+
+
+#endif
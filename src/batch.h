@@ -0,0 +1,211 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "settings.h"
+#include "util.h"
+#include "stats.h"
+#include "pal.h"
+
+
+/* If true, batches are submitted as one SDL_RenderGeometry call with
+per-vertex colors, which keeps rects in the order they were added.
+Otherwise rects are bucketed by palette index and submitted with one
+SDL_RenderFillRects per color; in that case callers must end a "layer"
+(draw_batch_end_layer) wherever rects of different colors may overlap. */
+#ifndef DRAW_BATCH_GEOMETRY
+#define DRAW_BATCH_GEOMETRY SDL_VERSION_ATLEAST(2, 0, 18)
+#endif
+
+
+struct draw_bucket_t {
+    int len;
+    int size;
+    SDL_Rect *rects;
+};
+
+struct draw_batch_t {
+    /* A frame-level buffer of solid-color rects, flushed with as few
+    draw calls and color changes as possible. */
+
+    /* If true, tiles are drawn as batched rects even when a tile cache
+    is available (see RENDER_MODE_RECTS) */
+    bool force_rects;
+
+#if DRAW_BATCH_GEOMETRY
+    int n_vertices;
+    int vertices_size;
+    SDL_Vertex *vertices;
+
+    int n_indices;
+    int indices_size;
+    int *indices;
+#else
+    /* palette which bucket indices refer to */
+    struct pal_t *pal;
+
+    /* rects bucketed by palette index */
+    int n_buckets;
+    struct draw_bucket_t *buckets;
+#endif
+};
+
+
+
+/**************
+ * DRAW BATCH *
+ **************/
+
+struct draw_batch_t *draw_batch_create(bool force_rects){
+    struct draw_batch_t *batch = malloc(sizeof(*batch));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating draw batch: %p, force_rects=%i\n", batch, force_rects);
+    }
+    if(batch == NULL)return NULL;
+    batch->force_rects = force_rects;
+#if DRAW_BATCH_GEOMETRY
+    batch->n_vertices = 0;
+    batch->vertices_size = 0;
+    batch->vertices = NULL;
+    batch->n_indices = 0;
+    batch->indices_size = 0;
+    batch->indices = NULL;
+#else
+    batch->pal = NULL;
+    batch->n_buckets = 0;
+    batch->buckets = NULL;
+#endif
+    return batch;
+}
+
+bool draw_batch_is_empty(struct draw_batch_t *batch){
+#if DRAW_BATCH_GEOMETRY
+    return batch->n_indices == 0;
+#else
+    for(int i = 0; i < batch->n_buckets; i++){
+        if(batch->buckets[i].len > 0)return false;
+    }
+    return true;
+#endif
+}
+
+int draw_batch_flush(struct draw_batch_t *batch, SDL_Renderer *renderer){
+    /* Submits and empties the batch */
+#if DRAW_BATCH_GEOMETRY
+    if(batch->n_indices == 0)return 0;
+    RET_IF_SDL_ERR(SDL_RenderGeometry(renderer, NULL,
+        batch->vertices, batch->n_vertices,
+        batch->indices, batch->n_indices));
+    RENDER_STAT(1, 0)
+    batch->n_vertices = 0;
+    batch->n_indices = 0;
+#else
+    for(int i = 0; i < batch->n_buckets; i++){
+        struct draw_bucket_t *bucket = &batch->buckets[i];
+        if(bucket->len == 0)continue;
+        SDL_Color *c = &batch->pal->colors[i];
+        RET_IF_SDL_ERR(SDL_SetRenderDrawColor(renderer, c->r, c->g, c->b, SDL_ALPHA_OPAQUE));
+        RET_IF_SDL_ERR(SDL_RenderFillRects(renderer, bucket->rects, bucket->len));
+        RENDER_STAT(1, 0)
+        bucket->len = 0;
+    }
+#endif
+    return 0;
+}
+
+int draw_batch_end_layer(struct draw_batch_t *batch, SDL_Renderer *renderer){
+    /* Marks the point after which rects may overlap ones already in the
+    batch. Only bucketed batches need to flush here; geometry batches
+    already preserve draw order. */
+#if DRAW_BATCH_GEOMETRY
+    return 0;
+#else
+    return draw_batch_flush(batch, renderer);
+#endif
+}
+
+#if DRAW_BATCH_GEOMETRY
+int draw_batch_add_rect(struct draw_batch_t *batch, SDL_Rect *rect, struct pal_t *pal, int color_i, SDL_Renderer *renderer){
+    if(batch->n_vertices + 4 > batch->vertices_size){
+        int new_size = batch->vertices_size == 0? 256: batch->vertices_size * 2;
+        SDL_Vertex *new_vertices = realloc(batch->vertices, sizeof(*new_vertices) * new_size);
+        if(new_vertices == NULL)return 1;
+        batch->vertices = new_vertices;
+        batch->vertices_size = new_size;
+    }
+    if(batch->n_indices + 6 > batch->indices_size){
+        int new_size = batch->indices_size == 0? 384: batch->indices_size * 2;
+        int *new_indices = realloc(batch->indices, sizeof(*new_indices) * new_size);
+        if(new_indices == NULL)return 1;
+        batch->indices = new_indices;
+        batch->indices_size = new_size;
+    }
+
+    RENDER_STAT(0, rect->w * rect->h)
+
+    float x0 = rect->x;
+    float y0 = rect->y;
+    float x1 = rect->x + rect->w;
+    float y1 = rect->y + rect->h;
+    int v = batch->n_vertices;
+    SDL_Vertex *vertices = &batch->vertices[v];
+    for(int i = 0; i < 4; i++){
+        vertices[i].position.x = i & 1? x1: x0;
+        vertices[i].position.y = i & 2? y1: y0;
+        vertices[i].color = pal->colors[color_i];
+        vertices[i].tex_coord.x = 0;
+        vertices[i].tex_coord.y = 0;
+    }
+    batch->n_vertices += 4;
+
+    /* Two triangles: 0 1 2, 2 1 3 */
+    int *indices = &batch->indices[batch->n_indices];
+    indices[0] = v + 0;
+    indices[1] = v + 1;
+    indices[2] = v + 2;
+    indices[3] = v + 2;
+    indices[4] = v + 1;
+    indices[5] = v + 3;
+    batch->n_indices += 6;
+    return 0;
+}
+#else
+int draw_batch_add_rect(struct draw_batch_t *batch, SDL_Rect *rect, struct pal_t *pal, int color_i, SDL_Renderer *renderer){
+    if(pal != batch->pal){
+        /* Bucket indices are only meaningful for one palette at a time */
+        RET_IF_NZ(draw_batch_flush(batch, renderer));
+        batch->pal = pal;
+    }
+    if(color_i >= batch->n_buckets){
+        int new_n_buckets = INT_MAX(color_i + 1, pal->len);
+        struct draw_bucket_t *new_buckets = realloc(batch->buckets, sizeof(*new_buckets) * new_n_buckets);
+        if(new_buckets == NULL)return 1;
+        for(int i = batch->n_buckets; i < new_n_buckets; i++){
+            new_buckets[i].len = 0;
+            new_buckets[i].size = 0;
+            new_buckets[i].rects = NULL;
+        }
+        batch->buckets = new_buckets;
+        batch->n_buckets = new_n_buckets;
+    }
+
+    struct draw_bucket_t *bucket = &batch->buckets[color_i];
+    if(bucket->len >= bucket->size){
+        int new_size = bucket->size == 0? 64: bucket->size * 2;
+        SDL_Rect *new_rects = realloc(bucket->rects, sizeof(*new_rects) * new_size);
+        if(new_rects == NULL)return 1;
+        bucket->rects = new_rects;
+        bucket->size = new_size;
+    }
+    bucket->rects[bucket->len++] = *rect;
+    RENDER_STAT(0, rect->w * rect->h)
+    return 0;
+}
+#endif
+
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef _BROAD_H_
+#define _BROAD_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+#include "entities.h"
+
+
+/*
+    Broad phase for sprite-vs-sprite tests: a uniform grid of
+    BROAD_CELL_SIZE x BROAD_CELL_SIZE cells over a room (in actual
+    pixels), each listing the entities whose rects touch it. Entities
+    off the edge of the room count as being in the edge cells.
+
+    broad_build fills it from a list of entities (e.g. a room's bucket),
+    from scratch: it's a couple of linear passes, so cheaper than keeping
+    it up to date as things move. Then broad_query finds the entities
+    whose rects overlap a given one, and broad_pairs finds all pairs of
+    entities whose rects overlap (candidates for e.g. collide_entities),
+    only looking at entities which share a cell.
+
+    Both report each result once, and in an order which only depends on
+    the order entities were given to broad_build.
+*/
+
+
+/* Called for each result of broad_query; returns 0 or an error code, which
+stops the query */
+typedef int broad_query_fn_t(void *data, int entity_i);
+
+/* Likewise for broad_pairs */
+typedef int broad_pair_fn_t(void *data, int entity_i, int entity_j);
+
+struct broad_t {
+    /* grid size, in cells */
+    int w;
+    int h;
+
+    /* entries 0 .. n-1: an entity index & its rect */
+    int n;
+    int cap;
+    int *entity_i;
+    SDL_Rect *rects;
+
+    /* cell c lists entries items[cell_start[c]] .. items[cell_start[c + 1]
+    - 1], in increasing order; cell_start has w * h + 1 elements */
+    int cells_cap;
+    int *cell_start;
+    int n_items;
+    int items_cap;
+    int *items;
+
+    /* per entry, the last query which reported it, so entries spanning
+    several cells are only reported once */
+    Uint32 *stamps;
+    Uint32 stamp;
+};
+
+
+
+/*********
+ * BROAD *
+ *********/
+
+struct broad_t *broad_create(){
+    struct broad_t *broad = calloc(1, sizeof(*broad));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating broad phase: %p\n", broad);
+    }
+    return broad;
+}
+
+void broad_destroy(struct broad_t *broad){
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying broad phase: %p\n", broad);
+    }
+    free(broad->entity_i);
+    free(broad->rects);
+    free(broad->cell_start);
+    free(broad->items);
+    free(broad->stamps);
+    free(broad);
+}
+
+int broad_cell_x(struct broad_t *broad, int x){
+    /* Column of the cell containing x, clamped to the grid */
+    if(x < 0)return 0;
+    int cell_x = x / BROAD_CELL_SIZE;
+    return cell_x < broad->w? cell_x: broad->w - 1;
+}
+
+int broad_cell_y(struct broad_t *broad, int y){
+    if(y < 0)return 0;
+    int cell_y = y / BROAD_CELL_SIZE;
+    return cell_y < broad->h? cell_y: broad->h - 1;
+}
+
+bool broad_rects_overlap(SDL_Rect *a, SDL_Rect *b){
+    return a->x < b->x + b->w && b->x < a->x + a->w && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+int broad_reserve(struct broad_t *broad, int n, int n_cells){
+    if(n > broad->cap){
+        int *new_entity_i = realloc(broad->entity_i, sizeof(*broad->entity_i) * n);
+        if(new_entity_i == NULL)return 1;
+        broad->entity_i = new_entity_i;
+        SDL_Rect *new_rects = realloc(broad->rects, sizeof(*broad->rects) * n);
+        if(new_rects == NULL)return 1;
+        broad->rects = new_rects;
+        Uint32 *new_stamps = realloc(broad->stamps, sizeof(*broad->stamps) * n);
+        if(new_stamps == NULL)return 1;
+        broad->stamps = new_stamps;
+        broad->cap = n;
+    }
+    if(n_cells + 1 > broad->cells_cap){
+        int *new_cell_start = realloc(broad->cell_start, sizeof(*broad->cell_start) * (n_cells + 1));
+        if(new_cell_start == NULL)return 1;
+        broad->cell_start = new_cell_start;
+        broad->cells_cap = n_cells + 1;
+    }
+    return 0;
+}
+
+int broad_build(struct broad_t *broad, struct entities_t *entities, const int *entity_i, int n, int room_w, int room_h){
+    /* Fills the grid with the n entities listed in entity_i, over a room
+    room_w x room_h actual pixels in size */
+    broad->w = room_w <= 0? 1: (room_w + BROAD_CELL_SIZE - 1) / BROAD_CELL_SIZE;
+    broad->h = room_h <= 0? 1: (room_h + BROAD_CELL_SIZE - 1) / BROAD_CELL_SIZE;
+    int n_cells = broad->w * broad->h;
+    RET_IF_NZ(broad_reserve(broad, n, n_cells));
+    broad->n = n;
+
+    /* Count each cell's entries... */
+    int *cell_start = broad->cell_start;
+    memset(cell_start, 0, sizeof(*cell_start) * (n_cells + 1));
+    int n_items = 0;
+    for(int k = 0; k < n; k++){
+        SDL_Rect *rect = &broad->rects[k];
+        broad->entity_i[k] = entity_i[k];
+        broad->stamps[k] = 0;
+        entity_get_rect(entities, entity_i[k], rect);
+        int x0 = broad_cell_x(broad, rect->x);
+        int x1 = broad_cell_x(broad, rect->x + rect->w - 1);
+        int y0 = broad_cell_y(broad, rect->y);
+        int y1 = broad_cell_y(broad, rect->y + rect->h - 1);
+        for(int y = y0; y <= y1; y++){
+            for(int x = x0; x <= x1; x++)cell_start[y * broad->w + x]++;
+        }
+        n_items += (x1 - x0 + 1) * (y1 - y0 + 1);
+    }
+    broad->stamp = 0;
+
+    if(n_items > broad->items_cap){
+        int *new_items = realloc(broad->items, sizeof(*broad->items) * n_items);
+        if(new_items == NULL)return 1;
+        broad->items = new_items;
+        broad->items_cap = n_items;
+    }
+    broad->n_items = n_items;
+
+    /* ...turn counts into where each cell's list ends... */
+    int end = 0;
+    for(int c = 0; c < n_cells; c++){
+        end += cell_start[c];
+        cell_start[c] = end;
+    }
+    cell_start[n_cells] = end;
+
+    /* ...and fill the lists from the back, leaving cell_start[c] at the
+    start of cell c's list, and each list in increasing order */
+    for(int k = n - 1; k >= 0; k--){
+        SDL_Rect *rect = &broad->rects[k];
+        int x0 = broad_cell_x(broad, rect->x);
+        int x1 = broad_cell_x(broad, rect->x + rect->w - 1);
+        int y0 = broad_cell_y(broad, rect->y);
+        int y1 = broad_cell_y(broad, rect->y + rect->h - 1);
+        for(int y = y0; y <= y1; y++){
+            for(int x = x0; x <= x1; x++)broad->items[--cell_start[y * broad->w + x]] = k;
+        }
+    }
+    return 0;
+}
+
+int broad_query(struct broad_t *broad, SDL_Rect *rect, broad_query_fn_t *fn, void *data){
+    /* Calls fn(data, entity_i) for each entity whose rect overlaps rect */
+    if(broad->n == 0)return 0;
+    if(++broad->stamp == 0){
+        /* Wrapped around: forget every entry's stamp */
+        memset(broad->stamps, 0, sizeof(*broad->stamps) * broad->n);
+        broad->stamp = 1;
+    }
+    Uint32 stamp = broad->stamp;
+    int x0 = broad_cell_x(broad, rect->x);
+    int x1 = broad_cell_x(broad, rect->x + rect->w - 1);
+    int y0 = broad_cell_y(broad, rect->y);
+    int y1 = broad_cell_y(broad, rect->y + rect->h - 1);
+    for(int y = y0; y <= y1; y++){
+        for(int x = x0; x <= x1; x++){
+            int c = y * broad->w + x;
+            for(int item = broad->cell_start[c]; item < broad->cell_start[c + 1]; item++){
+                int k = broad->items[item];
+                if(broad->stamps[k] == stamp)continue;
+                broad->stamps[k] = stamp;
+                if(!broad_rects_overlap(&broad->rects[k], rect))continue;
+                RET_IF_NZ(fn(data, broad->entity_i[k]));
+            }
+        }
+    }
+    return 0;
+}
+
+int broad_pairs(struct broad_t *broad, broad_pair_fn_t *fn, void *data){
+    /* Calls fn(data, entity_i, entity_j) for each pair of entities whose
+    rects overlap, entity_i being the one given to broad_build first */
+    if(broad->n == 0)return 0;
+    for(int c = 0; c < broad->w * broad->h; c++){
+        int start = broad->cell_start[c];
+        int end = broad->cell_start[c + 1];
+        for(int a = start; a < end; a++){
+            int k = broad->items[a];
+            SDL_Rect *rect = &broad->rects[k];
+            for(int b = a + 1; b < end; b++){
+                int l = broad->items[b];
+                SDL_Rect *other = &broad->rects[l];
+                if(!broad_rects_overlap(rect, other))continue;
+
+                /* Pairs sharing several cells are reported by the one
+                containing the top left of their overlap */
+                int x = broad_cell_x(broad, rect->x > other->x? rect->x: other->x);
+                int y = broad_cell_y(broad, rect->y > other->y? rect->y: other->y);
+                if(y * broad->w + x != c)continue;
+                RET_IF_NZ(fn(data, broad->entity_i[k], broad->entity_i[l]));
+            }
+        }
+    }
+    return 0;
+}
+
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef _COLLIDE_H_
+#define _COLLIDE_H_
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "settings.h"
+#include "util.h"
+#include "tileset.h"
+#include "map.h"
+#include "entities.h"
+
+#if COLLIDE_SIMD && defined(__SSE2__)
+#define COLLIDE_SSE2 1
+#include <emmintrin.h>
+#else
+#define COLLIDE_SSE2 0
+#endif
+
+
+/*
+    Pixel-accurate collision tests between tiles (i.e. sprites' frames,
+    and room tiles), using their mask_rows: each pair of rows which
+    overlap is tested with a shift & an AND.
+
+    Positions are in actual pixels, masks in tile pixels, each of which
+    covers TILE_PIXEL_W x TILE_PIXEL_H actual pixels. So if tile b is at
+    (dx, dy) relative to tile a, with dx = qx * TILE_PIXEL_W + rx (and
+    likewise for dy), then b's pixel (j, i) covers a's pixel (j + qx,
+    i + qy), plus its right neighbour if rx != 0, and the ones below
+    those if ry != 0.
+
+    Masks are a word per row, so tiles are at most 64 pixels wide (see
+    TILE_MAX_W).
+*/
+
+
+struct collide_offset_t {
+    /* (dx, dy) split as described above: dx = qx * TILE_PIXEL_W + rx,
+    0 <= rx < TILE_PIXEL_W, and likewise for dy */
+    int qx;
+    int rx;
+    int qy;
+    int ry;
+};
+
+void collide_offset_init(struct collide_offset_t *offset, int dx, int dy){
+    /* Splits (dx, dy), see collide_offset_t */
+    offset->qx = dx / TILE_PIXEL_W;
+    offset->rx = dx % TILE_PIXEL_W;
+    if(offset->rx < 0){
+        offset->qx--;
+        offset->rx += TILE_PIXEL_W;
+    }
+    offset->qy = dy / TILE_PIXEL_H;
+    offset->ry = dy % TILE_PIXEL_H;
+    if(offset->ry < 0){
+        offset->qy--;
+        offset->ry += TILE_PIXEL_H;
+    }
+}
+
+Uint64 collide_shift(Uint64 row, int n){
+    /* row << n, or row >> -n if n is negative */
+    if(n >= 64 || n <= -64)return 0;
+    return n >= 0? row << n: row >> -n;
+}
+
+Uint64 collide_smear(Uint64 row, struct collide_offset_t *offset){
+    /* Returns the bits of a row of a which a row of b covers */
+    Uint64 smeared = collide_shift(row, offset->qx);
+    if(offset->rx != 0)smeared |= collide_shift(row, offset->qx + 1);
+    return smeared;
+}
+
+bool collide_rows(const Uint64 *a, const Uint64 *b, struct collide_offset_t *offset, int i, int end){
+    /* Tests rows i .. end-1 of a, see collide_masks */
+    int qy = offset->qy;
+    for(; i < end; i++){
+        /* Rows of b over a's row i: i - qy, and the one above if ry != 0 */
+        Uint64 b_row = b[i - qy];
+        if(offset->ry != 0)b_row |= b[i - qy - 1];
+        if(a[i] & collide_smear(b_row, offset))return true;
+    }
+    return false;
+}
+
+#if COLLIDE_SSE2
+__m128i collide_shift_sse2(__m128i rows, int n){
+    /* Like collide_shift, for 2 rows at once (SSE2 shifts of 64 bits or
+    more give 0, just what we want) */
+    if(n >= 0)return _mm_sll_epi64(rows, _mm_cvtsi32_si128(n));
+    return _mm_srl_epi64(rows, _mm_cvtsi32_si128(-n));
+}
+
+bool collide_rows_sse2(const Uint64 *a, const Uint64 *b, struct collide_offset_t *offset, int i, int end){
+    /* Like collide_rows, 2 rows at a time */
+    int qy = offset->qy;
+    __m128i zero = _mm_setzero_si128();
+    for(; i + 2 <= end; i += 2){
+        __m128i b_rows = _mm_loadu_si128((const __m128i *)(b + i - qy));
+        if(offset->ry != 0)b_rows = _mm_or_si128(b_rows, _mm_loadu_si128((const __m128i *)(b + i - qy - 1)));
+        __m128i smeared = collide_shift_sse2(b_rows, offset->qx);
+        if(offset->rx != 0)smeared = _mm_or_si128(smeared, collide_shift_sse2(b_rows, offset->qx + 1));
+        __m128i hits = _mm_and_si128(_mm_loadu_si128((const __m128i *)(a + i)), smeared);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(hits, zero)) != 0xFFFF)return true;
+    }
+    return collide_rows(a, b, offset, i, end);
+}
+#endif
+
+bool collide_masks(const Uint64 *a, int a_h, const Uint64 *b, int b_h, int dx, int dy){
+    /* Whether mask rows a & b (see tile_get_mask_rows) overlap, b being
+    at (dx, dy) actual pixels relative to a */
+    struct collide_offset_t offset;
+    collide_offset_init(&offset, dx, dy);
+
+    /* Rows of a which b covers. The rows of b over them are in -1 .. b_h,
+    which mask_rows has room for. */
+    int i = offset.qy > 0? offset.qy: 0;
+    int end = offset.qy + b_h + (offset.ry != 0? 1: 0);
+    if(end > a_h)end = a_h;
+#if COLLIDE_SSE2
+    return collide_rows_sse2(a, b, &offset, i, end);
+#else
+    return collide_rows(a, b, &offset, i, end);
+#endif
+}
+
+bool collide_tiles(struct tileset_t *a_tileset, int a_i, int a_x, int a_y, struct tileset_t *b_tileset, int b_i, int b_x, int b_y){
+    /* Whether tile a_i of a_tileset at (a_x, a_y) overlaps tile b_i of
+    b_tileset at (b_x, b_y) */
+    int a_w = a_tileset->tile_w * TILE_PIXEL_W;
+    int a_h = a_tileset->tile_h * TILE_PIXEL_H;
+    int b_w = b_tileset->tile_w * TILE_PIXEL_W;
+    int b_h = b_tileset->tile_h * TILE_PIXEL_H;
+    if(a_x >= b_x + b_w || b_x >= a_x + a_w || a_y >= b_y + b_h || b_y >= a_y + a_h)return false;
+    return collide_masks(
+        tile_get_mask_rows(&a_tileset->tiles[a_i]), a_tileset->tile_h,
+        tile_get_mask_rows(&b_tileset->tiles[b_i]), b_tileset->tile_h,
+        b_x - a_x, b_y - a_y);
+}
+
+bool collide_entities(struct entities_t *entities, int i, int j){
+    /* Whether entities i & j (in their current frames) overlap */
+    if(entities->room_x[i] != entities->room_x[j] || entities->room_y[i] != entities->room_y[j]){
+        return false;
+    }
+    return collide_tiles(
+        entities->tileset[i], entities->frame[i], entities->x[i], entities->y[i],
+        entities->tileset[j], entities->frame[j], entities->x[j], entities->y[j]);
+}
+
+bool collide_entity_room_at(struct entities_t *entities, int i, int x, int y, struct room_t *room){
+    /* Whether entity i would overlap any of room's tiles (e.g. walls) if
+    it were at (x, y) */
+    struct tileset_t *tileset = room->tileset;
+    int cell_w = tileset->tile_w * TILE_PIXEL_W;
+    int cell_h = tileset->tile_h * TILE_PIXEL_H;
+    SDL_Rect rect;
+    entity_get_rect(entities, i, &rect);
+    rect.x = x;
+    rect.y = y;
+
+    /* Cells under the entity's rect */
+    int x0 = INT_MAX(0, INT_QUO(rect.x, cell_w));
+    int y0 = INT_MAX(0, INT_QUO(rect.y, cell_h));
+    int x1 = INT_MIN(room->w - 1, INT_QUO(rect.x + rect.w - 1, cell_w));
+    int y1 = INT_MIN(room->h - 1, INT_QUO(rect.y + rect.h - 1, cell_h));
+    for(int y = y0; y <= y1; y++){
+        for(int x = x0; x <= x1; x++){
+            int tile_i = grid_get(&room->data, y * room->w + x);
+            if(tile_i < 0)continue;
+            if(collide_tiles(entities->tileset[i], entities->frame[i], rect.x, rect.y,
+                tileset, tile_i, x * cell_w, y * cell_h
+            ))return true;
+        }
+    }
+    return false;
+}
+
+bool collide_entity_room(struct entities_t *entities, int i, struct room_t *room){
+    /* Whether entity i overlaps any of room's tiles; i is assumed to be in
+    room */
+    return collide_entity_room_at(entities, i, entities->x[i], entities->y[i], room);
+}
+
+
+#endif
@@ -0,0 +1,453 @@
+#ifndef _ENTITIES_H_
+#define _ENTITIES_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+#include "tileset.h"
+#include "sprite.h"
+#include "assets.h"
+#include "keymap.h"
+
+
+/*
+    The world's entities (sprites spawned into it), stored as parallel
+    arrays: entity i's position is (x[i], y[i]), its frame is frame[i],
+    etc. Entities 0 .. n-1 are all alive, so loops over them stream
+    through contiguous memory with no gaps to skip; removing one moves
+    the last into its place.
+
+    Since indices change, anything which keeps hold of an entity does so
+    through an entity_t handle, which entities_get_i turns back into its
+    current index. Handles of removed entities are reused, but with their
+    generation bumped, so stale copies are recognized as such.
+
+    Entities are also indexed by room: entities_get_bucket lists those in
+    a given room of the map, so e.g. rendering a room doesn't have to look
+    at everything else in the world.
+
+    Keycodes are mapped to the controller keys they're bound to, see
+    entities_set_keycodes.
+*/
+
+
+/* Handle to an entity: generation in the high bits, handle index (into
+entities_t::slots) in the low bits. 0 is never a valid handle. */
+typedef Uint32 entity_t;
+
+#define ENTITY_NONE 0
+#define ENTITY_INDEX_BITS 22
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_GEN_MASK ((1u << (32 - ENTITY_INDEX_BITS)) - 1)
+#define ENTITIES_MAX (1 << ENTITY_INDEX_BITS)
+
+struct entity_bucket_t {
+    /* Indices of the entities in one room, in no particular order */
+    int n;
+    int cap;
+    int *entity_i;
+};
+
+struct entities_t {
+    /* entities 0 .. n-1 are alive; arrays below have room for cap */
+    int n;
+    int cap;
+
+    /* per entity, by index */
+    int *room_x;
+    int *room_y;
+    int *x;
+    int *y;
+    int *frame;
+    struct tileset_t **tileset;
+
+    /* KEY_BIT(key) set for each key which is down, and for each key which
+    was down at some point since the last tick (see world_prepare_tick) */
+    Uint8 *key_is_down;
+    Uint8 *key_was_down;
+
+    struct controller_t *controller;
+    const char **name;
+    const char **fname;
+
+    /* handle index of each entity */
+    int *handle_i;
+
+    /* per handle index (n_handles of them, also with room for cap): index
+    of the entity it refers to, or if it's free, the next free handle
+    index (or -1); and its current generation */
+    int n_handles;
+    int *slots;
+    Uint32 *gens;
+
+    /* first free handle index, or -1 */
+    int free_handle_i;
+
+    /* A bucket per room of the map, room (x, y)'s being buckets[y * rooms_w
+    + x]; entity i is at bucket_pos[i] in its room's bucket */
+    int rooms_w;
+    int rooms_h;
+    struct entity_bucket_t *buckets;
+    int *bucket_pos;
+
+    /* Keycodes bound to entities' controllers' keys, owners being
+    entity_t handles */
+    struct keymap_t keymap;
+};
+
+
+#define ENTITIES_REALLOC(entities, field, cap) { \
+    void *new_field = realloc((entities)->field, sizeof(*(entities)->field) * (cap)); \
+    if(new_field == NULL)return 1; \
+    (entities)->field = new_field; \
+}
+
+
+
+/*****************
+ * ENTITY BUCKET *
+ *****************/
+
+int entity_bucket_reserve(struct entity_bucket_t *bucket, int cap){
+    if(cap <= bucket->cap)return 0;
+    int new_cap = bucket->cap * 2;
+    if(new_cap < cap)new_cap = cap;
+    int *new_entity_i = realloc(bucket->entity_i, sizeof(*bucket->entity_i) * new_cap);
+    if(new_entity_i == NULL)return 1;
+    bucket->entity_i = new_entity_i;
+    bucket->cap = new_cap;
+    return 0;
+}
+
+
+/************
+ * ENTITIES *
+ ************/
+
+struct entities_t *entities_create(int rooms_w, int rooms_h){
+    /* Makes an empty store for entities in a map of rooms_w x rooms_h
+    rooms */
+    struct entities_t *entities = calloc(1, sizeof(*entities));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating entities: %p, rooms_w=%i, rooms_h=%i\n", entities, rooms_w, rooms_h);
+    }
+    if(entities == NULL)return NULL;
+    entities->free_handle_i = -1;
+    keymap_init(&entities->keymap);
+    entities->rooms_w = rooms_w;
+    entities->rooms_h = rooms_h;
+    int n_rooms = rooms_w * rooms_h;
+    entities->buckets = n_rooms == 0? NULL: calloc(n_rooms, sizeof(*entities->buckets));
+    if(n_rooms != 0 && entities->buckets == NULL)return NULL;
+    return entities;
+}
+
+void entities_destroy(struct entities_t *entities, struct assets_t *assets){
+    /* Frees entities, releasing their tilesets */
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying entities: %p\n", entities);
+    }
+    for(int i = 0; i < entities->n; i++){
+        if(entities->tileset[i] != NULL)assets_release(assets, entities->tileset[i]);
+    }
+    free(entities->room_x);
+    free(entities->room_y);
+    free(entities->x);
+    free(entities->y);
+    free(entities->frame);
+    free(entities->tileset);
+    free(entities->key_is_down);
+    free(entities->key_was_down);
+    free(entities->controller);
+    free(entities->name);
+    free(entities->fname);
+    free(entities->handle_i);
+    free(entities->slots);
+    free(entities->gens);
+    for(int i = 0; i < entities->rooms_w * entities->rooms_h; i++){
+        free(entities->buckets[i].entity_i);
+    }
+    free(entities->buckets);
+    free(entities->bucket_pos);
+    keymap_cleanup(&entities->keymap);
+    free(entities);
+}
+
+int entities_reserve(struct entities_t *entities, int cap){
+    /* Makes room for cap entities in total */
+    if(cap <= entities->cap)return 0;
+    if(cap > ENTITIES_MAX){
+        LOG("Too many entities: cap=%i, max=%i\n", cap, ENTITIES_MAX);
+        return 2;
+    }
+    ENTITIES_REALLOC(entities, room_x, cap)
+    ENTITIES_REALLOC(entities, room_y, cap)
+    ENTITIES_REALLOC(entities, x, cap)
+    ENTITIES_REALLOC(entities, y, cap)
+    ENTITIES_REALLOC(entities, frame, cap)
+    ENTITIES_REALLOC(entities, tileset, cap)
+    ENTITIES_REALLOC(entities, key_is_down, cap)
+    ENTITIES_REALLOC(entities, key_was_down, cap)
+    ENTITIES_REALLOC(entities, controller, cap)
+    ENTITIES_REALLOC(entities, name, cap)
+    ENTITIES_REALLOC(entities, fname, cap)
+    ENTITIES_REALLOC(entities, handle_i, cap)
+    ENTITIES_REALLOC(entities, slots, cap)
+    ENTITIES_REALLOC(entities, gens, cap)
+    ENTITIES_REALLOC(entities, bucket_pos, cap)
+    entities->cap = cap;
+    return 0;
+}
+
+entity_t entities_get_entity(struct entities_t *entities, int i){
+    /* Returns a handle to entity i */
+    int handle_i = entities->handle_i[i];
+    return entities->gens[handle_i] << ENTITY_INDEX_BITS | handle_i;
+}
+
+int entities_get_i(struct entities_t *entities, entity_t entity){
+    /* Returns the current index of entity, or -1 if it's been removed */
+    int handle_i = entity & ENTITY_INDEX_MASK;
+    if(handle_i >= entities->n_handles)return -1;
+    if(entities->gens[handle_i] != entity >> ENTITY_INDEX_BITS)return -1;
+    int i = entities->slots[handle_i];
+    if(i < 0 || i >= entities->n || entities->handle_i[i] != handle_i)return -1;
+    return i;
+}
+
+struct entity_bucket_t *entities_get_bucket(struct entities_t *entities, int room_x, int room_y){
+    /* Returns the bucket listing the entities in room (room_x, room_y), or
+    NULL if that's outside the map */
+    if(room_x < 0 || room_x >= entities->rooms_w || room_y < 0 || room_y >= entities->rooms_h){
+        return NULL;
+    }
+    return &entities->buckets[room_y * entities->rooms_w + room_x];
+}
+
+void entities_bucket_remove(struct entities_t *entities, int i){
+    /* Takes entity i out of its room's bucket; the bucket's last entity
+    takes its place */
+    struct entity_bucket_t *bucket = entities_get_bucket(entities, entities->room_x[i], entities->room_y[i]);
+    int pos = entities->bucket_pos[i];
+    int last_i = bucket->entity_i[--bucket->n];
+    bucket->entity_i[pos] = last_i;
+    entities->bucket_pos[last_i] = pos;
+}
+
+int entities_set_room(struct entities_t *entities, int i, int room_x, int room_y){
+    /* Moves entity i to room (room_x, room_y) */
+    struct entity_bucket_t *bucket = entities_get_bucket(entities, room_x, room_y);
+    if(bucket == NULL){
+        LOG("Room out of range: room_x=%i, room_y=%i, rooms_w=%i, rooms_h=%i\n",
+            room_x, room_y, entities->rooms_w, entities->rooms_h);
+        return 2;
+    }
+    if(room_x == entities->room_x[i] && room_y == entities->room_y[i])return 0;
+    RET_IF_NZ(entity_bucket_reserve(bucket, bucket->n + 1));
+    entities_bucket_remove(entities, i);
+    entities->room_x[i] = room_x;
+    entities->room_y[i] = room_y;
+    entities->bucket_pos[i] = bucket->n;
+    bucket->entity_i[bucket->n++] = i;
+    return 0;
+}
+
+int entities_add(struct entities_t *entities, struct assets_t *assets, struct sprite_t *sprite,
+    int room_x, int room_y, int x, int y, bool is_cpu, entity_t *entity
+){
+    /* Adds an entity spawned from sprite, sharing its tileset. If entity
+    isn't NULL, it's set to the new entity's handle. */
+    if(entities->n == entities->cap){
+        int new_cap = entities->cap * 2;
+        if(new_cap == 0)new_cap = 16;
+        if(new_cap > ENTITIES_MAX)new_cap = ENTITIES_MAX;
+        RET_IF_NZ(entities_reserve(entities, new_cap));
+    }
+    struct entity_bucket_t *bucket = entities_get_bucket(entities, room_x, room_y);
+    if(bucket == NULL){
+        LOG("Room out of range: room_x=%i, room_y=%i, rooms_w=%i, rooms_h=%i\n",
+            room_x, room_y, entities->rooms_w, entities->rooms_h);
+        return 2;
+    }
+    RET_IF_NZ(entity_bucket_reserve(bucket, bucket->n + 1));
+    if(sprite->tileset != NULL)RET_IF_NZ(assets_retain(assets, sprite->tileset));
+
+    /* Handles never outnumber the most entities we've had at once, so
+    there's room for a new one if there are no free ones */
+    int handle_i = entities->free_handle_i;
+    if(handle_i >= 0){
+        entities->free_handle_i = entities->slots[handle_i];
+    }else{
+        handle_i = entities->n_handles++;
+        entities->gens[handle_i] = 1;
+    }
+
+    int i = entities->n++;
+    entities->slots[handle_i] = i;
+    entities->handle_i[i] = handle_i;
+    entities->room_x[i] = room_x;
+    entities->room_y[i] = room_y;
+    entities->x[i] = x;
+    entities->y[i] = y;
+    entities->frame[i] = 0;
+    entities->tileset[i] = sprite->tileset;
+    entities->key_is_down[i] = 0;
+    entities->key_was_down[i] = 0;
+    controller_init(&entities->controller[i], is_cpu);
+    entities->name[i] = sprite->name;
+    entities->fname[i] = sprite->fname;
+    entities->bucket_pos[i] = bucket->n;
+    bucket->entity_i[bucket->n++] = i;
+
+    if(entity != NULL)*entity = entities_get_entity(entities, i);
+    return 0;
+}
+
+void entities_unbind_keys(struct entities_t *entities, int i){
+    /* Unbinds entity i's controller's keycodes from its keys */
+    entity_t entity = entities_get_entity(entities, i);
+    struct controller_t *controller = &entities->controller[i];
+    for(int key = 0; key < KEYS; key++){
+        if(controller->keycodes[key] == SDLK_ESCAPE)continue;
+        keymap_unbind(&entities->keymap, controller->keycodes[key], entity, key);
+    }
+}
+
+int entities_remove(struct entities_t *entities, struct assets_t *assets, entity_t entity){
+    /* Removes entity, releasing its tileset. The last entity takes its
+    index (and in its room's bucket, the bucket's last entity takes its
+    place). */
+    int i = entities_get_i(entities, entity);
+    if(i < 0){
+        LOG("Tried to remove a removed entity: %u\n", (unsigned int)entity);
+        return 2;
+    }
+    if(entities->tileset[i] != NULL)RET_IF_NZ(assets_release(assets, entities->tileset[i]));
+    entities_bucket_remove(entities, i);
+    entities_unbind_keys(entities, i);
+
+    int handle_i = entities->handle_i[i];
+    entities->gens[handle_i] = (entities->gens[handle_i] + 1) & ENTITY_GEN_MASK;
+    if(entities->gens[handle_i] == 0)entities->gens[handle_i] = 1;
+    entities->slots[handle_i] = entities->free_handle_i;
+    entities->free_handle_i = handle_i;
+
+    int last = --entities->n;
+    if(i != last){
+        entities->handle_i[i] = entities->handle_i[last];
+        entities->slots[entities->handle_i[i]] = i;
+        entities->room_x[i] = entities->room_x[last];
+        entities->room_y[i] = entities->room_y[last];
+        entities->x[i] = entities->x[last];
+        entities->y[i] = entities->y[last];
+        entities->frame[i] = entities->frame[last];
+        entities->tileset[i] = entities->tileset[last];
+        entities->key_is_down[i] = entities->key_is_down[last];
+        entities->key_was_down[i] = entities->key_was_down[last];
+        entities->controller[i] = entities->controller[last];
+        entities->name[i] = entities->name[last];
+        entities->fname[i] = entities->fname[last];
+        entities->bucket_pos[i] = entities->bucket_pos[last];
+        struct entity_bucket_t *bucket = entities_get_bucket(entities, entities->room_x[i], entities->room_y[i]);
+        bucket->entity_i[entities->bucket_pos[i]] = i;
+    }
+    return 0;
+}
+
+struct controller_t *entities_get_controller(struct entities_t *entities, entity_t entity){
+    /* Returns entity's controller, or NULL if it's been removed */
+    int i = entities_get_i(entities, entity);
+    return i < 0? NULL: &entities->controller[i];
+}
+
+int entities_set_keycodes(struct entities_t *entities, entity_t entity, SDL_Keycode keycodes[KEYS]){
+    /* Sets the keycodes of entity's controller (see
+    controller_set_keycodes), rebinding them in entities->keymap so key
+    events can find it. May be called again at any time, to remap its
+    keys. */
+    int i = entities_get_i(entities, entity);
+    if(i < 0){
+        LOG("Tried to set keycodes of a removed entity: %u\n", (unsigned int)entity);
+        return 2;
+    }
+    entities_unbind_keys(entities, i);
+    controller_set_keycodes(&entities->controller[i], keycodes);
+    for(int key = 0; key < KEYS; key++){
+        if(keycodes[key] == SDLK_ESCAPE)continue;
+        RET_IF_NZ(keymap_bind(&entities->keymap, keycodes[key], entity, key));
+    }
+    return 0;
+}
+
+void entity_repr(struct entities_t *entities, int i, int depth){
+    if(DEBUG_REPR >= 1){
+        LOG("Dumping entity: %i\n", i);
+    }
+    print_tabs(depth);
+    LOG_RAW("entity=%u\n", (unsigned int)entities_get_entity(entities, i));
+    REPR_FIELD_EXT(entities, name, name[i], "%s", depth)
+    REPR_FIELD_EXT(entities, tileset, tileset[i]->fname, "%s", depth)
+    REPR_FIELD_EXT(entities, room_x, room_x[i], "%i", depth)
+    REPR_FIELD_EXT(entities, room_y, room_y[i], "%i", depth)
+    REPR_FIELD_EXT(entities, x, x[i], "%i", depth)
+    REPR_FIELD_EXT(entities, y, y[i], "%i", depth)
+    REPR_FIELD_EXT(entities, frame, frame[i], "%i", depth)
+    REPR_FIELD_EXT(entities, key_is_down, key_is_down[i], "%#x", depth)
+    REPR_FIELD_EXT(entities, key_was_down, key_was_down[i], "%#x", depth)
+    REPR_FIELD_MULTI(controller, depth)
+    controller_repr(&entities->controller[i], depth + 1);
+}
+
+void entities_repr(struct entities_t *entities, int depth){
+    if(DEBUG_REPR >= 1){
+        LOG("Dumping entities: %p\n", entities);
+    }
+    REPR_FIELD(entities, n, "%i", depth)
+    REPR_FIELD(entities, cap, "%i", depth)
+    REPR_FIELD_MULTI(keymap, depth)
+    keymap_repr(&entities->keymap, depth + 1);
+    for(int i = 0; i < entities->n; i++){
+        entity_repr(entities, i, depth);
+    }
+}
+
+
+/**********
+ * ENTITY *
+ **********/
+
+void entity_get_rect(struct entities_t *entities, int i, SDL_Rect *rect){
+    /* Sets rect to the area covered by entity i's current frame, in actual
+    pixels relative to the room */
+    struct tileset_t *tileset = entities->tileset[i];
+    rect->x = entities->x[i];
+    rect->y = entities->y[i];
+    rect->w = tileset->tile_w * TILE_PIXEL_W;
+    rect->h = tileset->tile_h * TILE_PIXEL_H;
+}
+
+int entity_render(struct entities_t *entities, int i, int world_x, int world_y, struct pal_t *pal, SDL_Renderer *renderer, struct draw_batch_t *batch){
+    if(DEBUG_RENDER >= 1){
+        LOG("Rendering entity: %i\n", i);
+    }
+
+    struct tileset_t *tileset = entities->tileset[i];
+    RET_IF_NZ(tileset_render_tile(tileset, entities->frame[i], world_x + entities->x[i], world_y + entities->y[i], pal, renderer, batch));
+    if(batch != NULL)RET_IF_NZ(draw_batch_end_layer(batch, renderer));
+
+    return 0;
+}
+
+void entity_render_framebuffer(struct entities_t *entities, int i, int world_x, int world_y, struct pal_t *pal, struct framebuffer_t *fb){
+    struct tileset_t *tileset = entities->tileset[i];
+    framebuffer_render_tile(fb, &tileset->tiles[entities->frame[i]], tileset->tile_w, tileset->tile_h,
+        world_x + entities->x[i], world_y + entities->y[i], pal);
+}
+
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef _FLOW_H_
+#define _FLOW_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+#include "map.h"
+#include "sprite.h"
+
+
+/*
+    A flow field over a room's tiles: for every tile, how far it is from
+    the nearest of some target tiles (e.g. where the players are), and
+    which way (KEY_U etc.) to step to get one tile closer.
+
+    It's built with a breadth-first search out from the targets, through
+    empty tiles (-1 in the room's data). Everything chasing those targets
+    then reads its next step from the field, so the cost of the search is
+    the same however many chasers there are; and it's only redone when
+    the targets move to other tiles (or the room changes), see
+    flow_field_update.
+*/
+
+
+/* dist of tiles no target can be reached from */
+#define FLOW_UNREACHABLE -1
+
+struct flow_field_t {
+    /* what the field was last built from: room (at room_version), and
+    target tiles 0 .. n_targets-1; room is NULL if it was never built */
+    struct room_t *room;
+    int room_version;
+    int n_targets;
+    int targets_cap;
+    int *targets;
+
+    /* room->w * room->h tiles, row-major; step is the KEY_BIT to step
+    towards the nearest target, or 0 on targets & unreachable tiles */
+    int w;
+    int h;
+    int cap;
+    int *dist;
+    Uint8 *step;
+
+    /* tiles waiting to be visited, during flow_field_build */
+    int *queue;
+};
+
+
+
+/********
+ * FLOW *
+ ********/
+
+void flow_field_init(struct flow_field_t *flow){
+    memset(flow, 0, sizeof(*flow));
+}
+
+void flow_field_cleanup(struct flow_field_t *flow){
+    free(flow->targets);
+    free(flow->dist);
+    free(flow->step);
+    free(flow->queue);
+    flow_field_init(flow);
+}
+
+int flow_field_reserve(struct flow_field_t *flow, int cap){
+    /* Makes room for cap tiles */
+    if(cap <= flow->cap)return 0;
+    int *dist = realloc(flow->dist, sizeof(*dist) * cap);
+    if(dist == NULL)return 1;
+    flow->dist = dist;
+    Uint8 *step = realloc(flow->step, sizeof(*step) * cap);
+    if(step == NULL)return 1;
+    flow->step = step;
+    int *queue = realloc(flow->queue, sizeof(*queue) * cap);
+    if(queue == NULL)return 1;
+    flow->queue = queue;
+    flow->cap = cap;
+    return 0;
+}
+
+void flow_field_visit(struct flow_field_t *flow, struct room_t *room, int *tail, int tile_i, int from_i, int key){
+    /* Reaches tile_i from its neighbour from_i, which is a step of key
+    away, unless tile_i is a wall or was reached already */
+    if(flow->dist[tile_i] != FLOW_UNREACHABLE)return;
+    if(grid_get(&room->data, tile_i) >= 0)return;
+    flow->dist[tile_i] = flow->dist[from_i] + 1;
+    flow->step[tile_i] = KEY_BIT(key);
+    flow->queue[(*tail)++] = tile_i;
+}
+
+int flow_field_build(struct flow_field_t *flow, struct room_t *room, const int *targets, int n_targets){
+    /* Rebuilds the field over room from scratch, with targets (tile
+    indices, which may repeat) as the starting points of the search */
+    int w = room->w;
+    int h = room->h;
+    RET_IF_NZ(flow_field_reserve(flow, w * h));
+    flow->w = w;
+    flow->h = h;
+    for(int i = 0; i < w * h; i++)flow->dist[i] = FLOW_UNREACHABLE;
+    memset(flow->step, 0, w * h);
+
+    /* Each tile is queued at most once, so the queue needs no wrapping */
+    int head = 0;
+    int tail = 0;
+    for(int i = 0; i < n_targets; i++){
+        int tile_i = targets[i];
+        if(flow->dist[tile_i] != FLOW_UNREACHABLE)continue;
+        flow->dist[tile_i] = 0;
+        flow->queue[tail++] = tile_i;
+    }
+    while(head < tail){
+        int tile_i = flow->queue[head++];
+        int x = tile_i % w;
+        int y = tile_i / w;
+
+        /* The neighbour above steps down to get here, etc. */
+        if(y > 0)flow_field_visit(flow, room, &tail, tile_i - w, tile_i, KEY_D);
+        if(y < h - 1)flow_field_visit(flow, room, &tail, tile_i + w, tile_i, KEY_U);
+        if(x > 0)flow_field_visit(flow, room, &tail, tile_i - 1, tile_i, KEY_R);
+        if(x < w - 1)flow_field_visit(flow, room, &tail, tile_i + 1, tile_i, KEY_L);
+    }
+    return 0;
+}
+
+int flow_field_update(struct flow_field_t *flow, struct room_t *room, const int *targets, int n_targets){
+    /* Makes the field lead to targets (in order, as given last time) over
+    room, rebuilding it only if any of those changed since it was last
+    built. Usually (chasers on the move, targets within the same tiles)
+    this is just a comparison of a few ints. */
+    if(flow->room == room && flow->room_version == room->version && flow->n_targets == n_targets &&
+        (n_targets == 0 || memcmp(flow->targets, targets, sizeof(*targets) * n_targets) == 0)
+    )return 0;
+
+    if(n_targets > flow->targets_cap){
+        int *new_targets = realloc(flow->targets, sizeof(*new_targets) * n_targets);
+        if(new_targets == NULL)return 1;
+        flow->targets = new_targets;
+        flow->targets_cap = n_targets;
+    }
+    if(n_targets > 0)memcpy(flow->targets, targets, sizeof(*targets) * n_targets);
+    flow->n_targets = n_targets;
+
+    /* Forget what it was built from until it's been built, so a failure
+    doesn't leave a half-built field looking up to date */
+    flow->room = NULL;
+    RET_IF_NZ(flow_field_build(flow, room, targets, n_targets));
+    flow->room = room;
+    flow->room_version = room->version;
+    return 0;
+}
+
+Uint8 flow_field_get_step(struct flow_field_t *flow, int tile_i){
+    /* Returns the KEY_BIT to step from tile_i towards the nearest target,
+    or 0 if it's a target or there's no way to one */
+    return flow->step[tile_i];
+}
+
+void flow_field_repr(struct flow_field_t *flow, int depth){
+    if(DEBUG_REPR >= 1){
+        LOG("Dumping flow field: %p\n", flow);
+    }
+    REPR_FIELD(flow, w, "%i", depth)
+    REPR_FIELD(flow, h, "%i", depth)
+    REPR_FIELD(flow, n_targets, "%i", depth)
+    REPR_FIELD_MULTI(dist, depth)
+    if(flow->room != NULL)repr_intmap(flow->dist, flow->w, flow->h, "%3s", "%3i", depth + 1);
+}
+
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef _FRAMEBUFFER_H_
+#define _FRAMEBUFFER_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "settings.h"
+#include "util.h"
+#include "stats.h"
+#include "pal.h"
+#include "tileset.h"
+
+
+struct framebuffer_t {
+    /* A CPU-side ARGB8888 image which things are rasterized into, then
+    uploaded to a streaming texture once per frame. */
+
+    /* w, h in actual pixels */
+    int w;
+    int h;
+    Uint32 *pixels;
+
+    /* drawing is clipped to this rect (initially the whole framebuffer) */
+    SDL_Rect clip;
+
+    /* texture we upload to, created on first present */
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+};
+
+
+
+/***************
+ * FRAMEBUFFER *
+ ***************/
+
+void framebuffer_reset_clip(struct framebuffer_t *fb){
+    fb->clip.x = 0;
+    fb->clip.y = 0;
+    fb->clip.w = fb->w;
+    fb->clip.h = fb->h;
+}
+
+bool framebuffer_set_clip(struct framebuffer_t *fb, SDL_Rect *rect){
+    /* Clips drawing to rect (within the framebuffer). Returns false if
+    that leaves nothing to draw to. */
+    SDL_Rect bounds = {0, 0, fb->w, fb->h};
+    return SDL_IntersectRect(&bounds, rect, &fb->clip);
+}
+
+struct framebuffer_t *framebuffer_create(int w, int h){
+    struct framebuffer_t *fb = malloc(sizeof(*fb));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating framebuffer: %p, w=%i, h=%i\n", fb, w, h);
+    }
+    if(fb == NULL)return NULL;
+    fb->w = w;
+    fb->h = h;
+    fb->renderer = NULL;
+    fb->texture = NULL;
+    framebuffer_reset_clip(fb);
+    fb->pixels = malloc(sizeof(*fb->pixels) * w * h);
+    if(fb->pixels == NULL)return NULL;
+    return fb;
+}
+
+void framebuffer_fill_span(Uint32 *dst, Uint32 color, int n){
+    /* Writes n copies of color to dst. Build with e.g. -mavx2 (or
+    -march=native) to get the 8-wide path; SSE2 is always there on x86-64. */
+#if defined(__AVX2__)
+    __m256i color8 = _mm256_set1_epi32(color);
+    for(; n >= 8; n -= 8, dst += 8){
+        _mm256_storeu_si256((__m256i *)dst, color8);
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i color4 = _mm_set1_epi32(color);
+    for(; n >= 4; n -= 4, dst += 4){
+        _mm_storeu_si128((__m128i *)dst, color4);
+    }
+#endif
+    for(; n > 0; n--)*dst++ = color;
+}
+
+void framebuffer_fill_rect(struct framebuffer_t *fb, int x, int y, int w, int h, Uint32 color){
+    /* Fills a rect, clipped to fb->clip */
+    SDL_Rect *clip = &fb->clip;
+    int x0 = INT_MAX(x, clip->x);
+    int y0 = INT_MAX(y, clip->y);
+    int x1 = INT_MIN(x + w, clip->x + clip->w);
+    int y1 = INT_MIN(y + h, clip->y + clip->h);
+    if(x0 >= x1 || y0 >= y1)return;
+    RENDER_STAT(0, (x1 - x0) * (y1 - y0))
+    for(int i = y0; i < y1; i++){
+        framebuffer_fill_span(&fb->pixels[i * fb->w + x0], color, x1 - x0);
+    }
+}
+
+void framebuffer_clear(struct framebuffer_t *fb, Uint32 color){
+    framebuffer_fill_span(fb->pixels, color, fb->w * fb->h);
+    RENDER_STAT(0, fb->w * fb->h)
+}
+
+void framebuffer_copy_rect(struct framebuffer_t *fb, struct framebuffer_t *src, SDL_Rect *rect){
+    /* Copies rect from src (which must be the same size as fb) into fb,
+    clipped to fb->clip */
+    SDL_Rect r;
+    if(!SDL_IntersectRect(&fb->clip, rect, &r))return;
+    RENDER_STAT(0, r.w * r.h)
+    for(int i = r.y; i < r.y + r.h; i++){
+        memcpy(&fb->pixels[i * fb->w + r.x], &src->pixels[i * src->w + r.x], sizeof(*fb->pixels) * r.w);
+    }
+}
+
+void framebuffer_render_tile(struct framebuffer_t *fb, struct tile_t *tile, int tile_w, int tile_h, int tile_x, int tile_y, struct pal_t *pal){
+    /* Rasterizes a tile scaled up by TILE_PIXEL_W x TILE_PIXEL_H, with each
+    horizontal run of same-colored pixels written as one span */
+    Uint32 *colors = pal->argb;
+    int row[TILE_MAX_W];
+    int y = tile_y;
+    for(int i = 0; i < tile_h; i++){
+        tile_get_row(tile, tile_w, i, row);
+        int j = 0;
+        while(j < tile_w){
+            int color_i = row[j];
+            int run = 1;
+            while(j + run < tile_w && row[j + run] == color_i)run++;
+            if(color_i >= 0 && color_i < pal->len){
+                framebuffer_fill_rect(fb, tile_x + j * TILE_PIXEL_W, y,
+                    run * TILE_PIXEL_W, TILE_PIXEL_H, colors[color_i]);
+            }
+            j += run;
+        }
+        y += TILE_PIXEL_H;
+    }
+}
+
+int framebuffer_present(struct framebuffer_t *fb, SDL_Renderer *renderer, int x, int y, SDL_Rect *rects, int n_rects){
+    /* Uploads the framebuffer and copies it to the renderer at x, y.
+    If rects isn't NULL, only those parts of the texture are updated
+    (as long as it already existed, otherwise all of it is). */
+    if(fb->renderer != renderer){
+        rects = NULL;
+        if(fb->texture != NULL)SDL_DestroyTexture(fb->texture);
+        fb->renderer = renderer;
+        fb->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING, fb->w, fb->h);
+        if(fb->texture == NULL){
+            fb->renderer = NULL;
+            ERR_INFO(); fprintf(stderr, "SDL error: %s\n", SDL_GetError());
+            return 2;
+        }
+    }
+    int pitch = sizeof(*fb->pixels) * fb->w;
+    if(rects == NULL){
+        RET_IF_SDL_ERR(SDL_UpdateTexture(fb->texture, NULL, fb->pixels, pitch));
+    }else{
+        SDL_Rect bounds = {0, 0, fb->w, fb->h};
+        for(int i = 0; i < n_rects; i++){
+            SDL_Rect r;
+            if(!SDL_IntersectRect(&bounds, &rects[i], &r))continue;
+            RET_IF_SDL_ERR(SDL_UpdateTexture(fb->texture, &r, &fb->pixels[r.y * fb->w + r.x], pitch));
+        }
+    }
+    SDL_Rect dst = {x, y, fb->w, fb->h};
+    RET_IF_SDL_ERR(SDL_RenderCopy(renderer, fb->texture, NULL, &dst));
+    RENDER_STAT(1, dst.w * dst.h)
+    return 0;
+}
+
+
+#endif
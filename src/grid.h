@@ -0,0 +1,176 @@
+#ifndef _GRID_H_
+#define _GRID_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+#include "parse.h"
+#include "pack.h"
+
+
+/*
+    A 2d array of small indices (e.g. a room's tiles, a map's rooms), each
+    either -1 ("nothing here") or 0 .. GRID_MAX_VALUE.
+    Cells are 1 byte if every value fits, otherwise 2, decided when the
+    grid is created; -1 is stored as the all-ones value of either width.
+    Read cells with grid_get, write them with grid_set.
+*/
+
+
+#define GRID_MAX_VALUE 0xFFFE
+
+struct grid_t {
+    int w;
+    int h;
+
+    /* 1 or 2 */
+    int cell_size;
+
+    /* w * h cells, row-major; Uint16s if cell_size is 2 */
+    Uint8 *data;
+};
+
+
+
+/********
+ * GRID *
+ ********/
+
+int grid_init(struct grid_t *grid, int w, int h, int max_value){
+    /* Makes a grid able to hold values up to max_value, filled with -1 */
+    if(max_value > GRID_MAX_VALUE){
+        LOG("Grid value out of range: max_value=%i, max=%i\n", max_value, GRID_MAX_VALUE);
+        return 2;
+    }
+    int size = w * h;
+    grid->w = w;
+    grid->h = h;
+    grid->cell_size = max_value < 0xFF? 1: 2;
+    grid->data = size == 0? NULL: malloc(grid->cell_size * size);
+    if(size != 0 && grid->data == NULL)return 1;
+    if(size != 0)memset(grid->data, 0xFF, grid->cell_size * size);
+    return 0;
+}
+
+int grid_init_values(struct grid_t *grid, int w, int h, const int *values){
+    /* Makes a grid holding values, which has w * h elements; cells are as
+    narrow as its largest element allows */
+    int size = w * h;
+    int max_value = -1;
+    for(int i = 0; i < size; i++){
+        if(values[i] < -1){
+            LOG("Grid value out of range: %i\n", values[i]);
+            return 2;
+        }
+        if(values[i] > max_value)max_value = values[i];
+    }
+    RET_IF_NZ(grid_init(grid, w, h, max_value));
+    if(grid->cell_size == 1){
+        for(int i = 0; i < size; i++)grid->data[i] = values[i];
+    }else{
+        Uint16 *data = (Uint16 *)grid->data;
+        for(int i = 0; i < size; i++)data[i] = values[i];
+    }
+    return 0;
+}
+
+void grid_cleanup(struct grid_t *grid){
+    free(grid->data);
+    grid->data = NULL;
+}
+
+int grid_get(struct grid_t *grid, int i){
+    /* Returns cell i, i.e. row * w + col */
+    if(grid->cell_size == 1){
+        int value = grid->data[i];
+        return value == 0xFF? -1: value;
+    }
+    int value = ((Uint16 *)grid->data)[i];
+    return value == 0xFFFF? -1: value;
+}
+
+int grid_set(struct grid_t *grid, int i, int value){
+    /* Sets cell i, which fails if value doesn't fit the grid's cells */
+    int max_value = grid->cell_size == 1? 0xFE: GRID_MAX_VALUE;
+    if(value < -1 || value > max_value){
+        LOG("Grid value out of range: %i, max=%i\n", value, max_value);
+        return 2;
+    }
+    if(grid->cell_size == 1)grid->data[i] = value;
+    else ((Uint16 *)grid->data)[i] = value;
+    return 0;
+}
+
+size_t grid_get_size(struct grid_t *grid){
+    /* Bytes used by the cells */
+    return (size_t)grid->cell_size * grid->w * grid->h;
+}
+
+int grid_parse(struct grid_t *grid, struct parser_t *parser, int w, int h, int base){
+    /* Parses the grid as an intmap, see parse_intmap */
+    int size = w * h;
+    int *values = size == 0? NULL: malloc(sizeof(*values) * size);
+    if(size != 0 && values == NULL)return 1;
+    int e = parse_intmap(parser, values, w, h, base);
+    if(!e)e = grid_init_values(grid, w, h, values);
+    free(values);
+    return e;
+}
+
+void grid_repr(struct grid_t *grid, int depth){
+    int size = grid->w * grid->h;
+    int *values = size == 0? NULL: malloc(sizeof(*values) * size);
+    if(size != 0 && values == NULL)return;
+    for(int i = 0; i < size; i++)values[i] = grid_get(grid, i);
+    repr_intmap(values, grid->w, grid->h, "%3s", "%3i", depth);
+    free(values);
+}
+
+
+/********
+ * PACK *
+ ********/
+
+int pack_write_grid(struct pack_writer_t *writer, struct grid_t *grid){
+    /* Writes cell_size, then the cells (little-endian, padded to 4 bytes) */
+    int size = grid->w * grid->h;
+    RET_IF_NZ(pack_write_i32(writer, grid->cell_size));
+    if(grid->cell_size == 1)return pack_write_bytes(writer, grid->data, size);
+
+    Uint16 *data = (Uint16 *)grid->data;
+    Uint8 *bytes = size == 0? NULL: malloc(size * 2);
+    if(size != 0 && bytes == NULL)return 1;
+    for(int i = 0; i < size; i++){
+        bytes[i * 2] = data[i];
+        bytes[i * 2 + 1] = data[i] >> 8;
+    }
+    int e = pack_write_bytes(writer, bytes, size * 2);
+    free(bytes);
+    return e;
+}
+
+int pack_read_grid(struct pack_reader_t *reader, struct grid_t *grid, int w, int h){
+    /* Reads what pack_write_grid wrote into a new w x h grid */
+    int cell_size = pack_read_i32(reader);
+    if(cell_size != 1 && cell_size != 2)reader->failed = true;
+    pack_reader_has(reader, (Uint64)w * h * cell_size);
+    RET_IF_NZ(pack_reader_check(reader));
+
+    RET_IF_NZ(grid_init(grid, w, h, cell_size == 1? 0: GRID_MAX_VALUE));
+    pack_read_bytes(reader, grid->data, w * h * cell_size);
+#if SDL_BYTEORDER != SDL_LIL_ENDIAN
+    if(cell_size == 2){
+        Uint16 *data = (Uint16 *)grid->data;
+        for(int i = 0; i < w * h; i++)data[i] = SDL_Swap16(data[i]);
+    }
+#endif
+    return pack_reader_check(reader);
+}
+
+
+#endif
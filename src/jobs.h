@@ -0,0 +1,335 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "settings.h"
+#include "util.h"
+
+
+/*
+    A small pool of worker threads, for spreading a batch of independent
+    jobs over the machine's cores, e.g. loading a map's rooms, or ticking
+    chunks of the world's entities.
+
+    job_pool_run(pool, fn, data, n) calls fn(data, i) for each i in
+    0 .. n-1, on the workers and on the calling thread, and returns once
+    they've all finished. Jobs may run in any order, so each should only
+    write to its own slot of whatever data points to.
+
+    Jobs are handed out by work stealing: each thread starts with a queue
+    holding its own contiguous share of the batch, which it works through
+    front to back, touching no shared state but its queue's spin lock.
+    When its queue runs dry, it steals the back half of another's. So
+    threads mostly stay out of each other's way (and on neighbouring
+    jobs), while one which got slow jobs, or got descheduled, doesn't
+    hold everyone else up.
+
+    Alternatively, job_pool_start hands a batch to the workers and returns
+    straight away, e.g. to load things in the background; check on it with
+    job_pool_is_done, and finish it with job_pool_wait. Only one batch
+    runs at a time.
+
+    Jobs mustn't touch SDL's video or render functions (which must only be
+    called from the main thread), nor run another batch on the same pool.
+
+    A NULL pool (or one with no workers) runs the jobs one by one on the
+    calling thread.
+*/
+
+
+/* Job i of a batch; returns 0 or an error code */
+typedef int job_fn_t(void *data, int i);
+
+/* Size to pad each job_queue_t to, so threads don't fight over cache
+lines */
+#define JOB_QUEUE_SIZE 64
+
+struct job_queue_t {
+    /* Jobs next .. end-1 of the current batch are in this queue: its
+    owner takes them from the front, thieves from the back */
+    SDL_SpinLock lock;
+    int next;
+    int end;
+    Uint8 pad[JOB_QUEUE_SIZE - 3 * sizeof(int)];
+};
+
+struct job_worker_t {
+    struct job_pool_t *pool;
+
+    /* its queue, in pool->queues */
+    int queue_i;
+};
+
+struct job_pool_t {
+    int n_threads;
+    SDL_Thread **threads;
+    struct job_worker_t *workers;
+
+    /* a queue per worker, then one for whichever thread calls
+    job_pool_wait (or job_pool_run) */
+    int n_queues;
+    struct job_queue_t *queues;
+
+    /* guards batch, n_busy & stopping, and the queues being refilled */
+    SDL_mutex *mutex;
+
+    /* signalled when a batch starts, or the pool stops */
+    SDL_cond *work_cond;
+
+    /* signalled when the last job of a batch finishes */
+    SDL_cond *done_cond;
+
+    /* bumped whenever a batch starts */
+    int batch;
+
+    /* workers in job_pool_work; a batch isn't over until they've all
+    left it, so none can still be looking for jobs when the next one
+    fills the queues */
+    int n_busy;
+
+    bool stopping;
+
+    /* the current batch, set before its jobs are queued */
+    job_fn_t *fn;
+    void *data;
+    int n;
+    SDL_atomic_t n_done;
+
+    /* first error returned by a job of the current batch */
+    SDL_atomic_t e;
+};
+
+
+
+/************
+ * JOB POOL *
+ ************/
+
+bool job_pool_take(struct job_pool_t *pool, int queue_i, int *i){
+    /* Takes the job at the front of queue queue_i, if any */
+    struct job_queue_t *queue = &pool->queues[queue_i];
+    SDL_AtomicLock(&queue->lock);
+    bool took = queue->next < queue->end;
+    if(took)*i = queue->next++;
+    SDL_AtomicUnlock(&queue->lock);
+    return took;
+}
+
+bool job_pool_steal(struct job_pool_t *pool, int queue_i, int *i){
+    /* Moves the back half of another queue's jobs into queue queue_i
+    (which is empty), & takes the first of them. Returns false if every
+    queue is empty. */
+    for(int k = 1; k < pool->n_queues; k++){
+        struct job_queue_t *victim = &pool->queues[(queue_i + k) % pool->n_queues];
+        SDL_AtomicLock(&victim->lock);
+        int n_stolen = (victim->end - victim->next + 1) / 2;
+        int end = victim->end;
+        victim->end -= n_stolen;
+        SDL_AtomicUnlock(&victim->lock);
+        if(n_stolen <= 0)continue;
+
+        struct job_queue_t *queue = &pool->queues[queue_i];
+        *i = end - n_stolen;
+        SDL_AtomicLock(&queue->lock);
+        queue->next = end - n_stolen + 1;
+        queue->end = end;
+        SDL_AtomicUnlock(&queue->lock);
+        return true;
+    }
+    return false;
+}
+
+void job_pool_work(struct job_pool_t *pool, int queue_i){
+    /* Runs jobs of the current batch from queue queue_i, then from
+    whichever other queues it can steal from, until there are none left
+    to take */
+    int i;
+    while(job_pool_take(pool, queue_i, &i) || job_pool_steal(pool, queue_i, &i)){
+        int n = pool->n;
+        int e = pool->fn(pool->data, i);
+        if(e)SDL_AtomicCAS(&pool->e, 0, e);
+        if(SDL_AtomicAdd(&pool->n_done, 1) + 1 == n){
+            /* Wake job_pool_wait */
+            SDL_LockMutex(pool->mutex);
+            SDL_CondBroadcast(pool->done_cond);
+            SDL_UnlockMutex(pool->mutex);
+        }
+    }
+}
+
+int job_pool_worker(void *data){
+    struct job_worker_t *worker = data;
+    struct job_pool_t *pool = worker->pool;
+    int batch = 0;
+    SDL_LockMutex(pool->mutex);
+    while(!pool->stopping){
+        if(pool->batch == batch){
+            SDL_CondWait(pool->work_cond, pool->mutex);
+            continue;
+        }
+        batch = pool->batch;
+
+        /* If we're late, the batch may be over already */
+        if(SDL_AtomicGet(&pool->n_done) == pool->n)continue;
+        pool->n_busy++;
+        SDL_UnlockMutex(pool->mutex);
+        job_pool_work(pool, worker->queue_i);
+        SDL_LockMutex(pool->mutex);
+        if(--pool->n_busy == 0)SDL_CondBroadcast(pool->done_cond);
+    }
+    SDL_UnlockMutex(pool->mutex);
+    return 0;
+}
+
+struct job_pool_t *job_pool_create(int n_threads){
+    /* Starts n_threads workers; if n_threads is 0, one per core other than
+    the calling thread's (which runs jobs too, see job_pool_run) */
+    if(n_threads == 0)n_threads = SDL_GetCPUCount() - 1;
+    if(n_threads < 0)n_threads = 0;
+
+    struct job_pool_t *pool = malloc(sizeof(*pool));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating job pool: %p, n_threads=%i\n", pool, n_threads);
+    }
+    if(pool == NULL)return NULL;
+    pool->n_threads = 0;
+    pool->batch = 0;
+    pool->n_busy = 0;
+    pool->stopping = false;
+    pool->fn = NULL;
+    pool->data = NULL;
+    pool->n = 0;
+    SDL_AtomicSet(&pool->n_done, 0);
+    SDL_AtomicSet(&pool->e, 0);
+
+    pool->mutex = SDL_CreateMutex();
+    pool->work_cond = SDL_CreateCond();
+    pool->done_cond = SDL_CreateCond();
+    if(pool->mutex == NULL || pool->work_cond == NULL || pool->done_cond == NULL){
+        LOG("Couldn't create job pool: %s\n", SDL_GetError());
+        return NULL;
+    }
+
+    pool->n_queues = n_threads + 1;
+    pool->queues = calloc(pool->n_queues, sizeof(*pool->queues));
+    if(pool->queues == NULL)return NULL;
+
+    pool->threads = n_threads == 0? NULL: malloc(sizeof(*pool->threads) * n_threads);
+    pool->workers = n_threads == 0? NULL: malloc(sizeof(*pool->workers) * n_threads);
+    if(n_threads != 0 && (pool->threads == NULL || pool->workers == NULL))return NULL;
+    for(int i = 0; i < n_threads; i++){
+        struct job_worker_t *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->queue_i = i;
+        SDL_Thread *thread = SDL_CreateThread(job_pool_worker, "job", worker);
+        if(thread == NULL){
+            /* Fine, we'll make do with the ones we've got */
+            LOG("Couldn't start job thread %i: %s\n", i, SDL_GetError());
+            break;
+        }
+        pool->threads[pool->n_threads++] = thread;
+    }
+
+    /* The calling thread's queue comes right after the workers' */
+    pool->n_queues = pool->n_threads + 1;
+    return pool;
+}
+
+void job_pool_destroy(struct job_pool_t *pool){
+    /* Stops & joins the workers; mustn't be called with a batch in
+    progress */
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying job pool: %p\n", pool);
+    }
+    SDL_LockMutex(pool->mutex);
+    pool->stopping = true;
+    SDL_CondBroadcast(pool->work_cond);
+    SDL_UnlockMutex(pool->mutex);
+    for(int i = 0; i < pool->n_threads; i++){
+        SDL_WaitThread(pool->threads[i], NULL);
+    }
+    SDL_DestroyCond(pool->done_cond);
+    SDL_DestroyCond(pool->work_cond);
+    SDL_DestroyMutex(pool->mutex);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->queues);
+    free(pool);
+}
+
+void job_pool_start(struct job_pool_t *pool, job_fn_t *fn, void *data, int n){
+    /* Hands fn(data, i) for i in 0 .. n-1 to the workers, without waiting.
+    The pool must have workers, and no batch in progress; the batch is in
+    progress until job_pool_wait returns. */
+    SDL_LockMutex(pool->mutex);
+    pool->fn = fn;
+    pool->data = data;
+    pool->n = n;
+    SDL_AtomicSet(&pool->n_done, 0);
+    SDL_AtomicSet(&pool->e, 0);
+
+    /* Each queue gets an equal share; the waiting thread's gets stolen
+    until it shows up */
+    for(int q = 0; q < pool->n_queues; q++){
+        struct job_queue_t *queue = &pool->queues[q];
+        SDL_AtomicLock(&queue->lock);
+        queue->next = (Sint64)n * q / pool->n_queues;
+        queue->end = (Sint64)n * (q + 1) / pool->n_queues;
+        SDL_AtomicUnlock(&queue->lock);
+    }
+    pool->batch++;
+    SDL_CondBroadcast(pool->work_cond);
+    SDL_UnlockMutex(pool->mutex);
+}
+
+bool job_pool_is_done(struct job_pool_t *pool){
+    /* Whether all jobs of the batch have finished, i.e. job_pool_wait
+    wouldn't block */
+    SDL_LockMutex(pool->mutex);
+    bool done = SDL_AtomicGet(&pool->n_done) == pool->n && pool->n_busy == 0;
+    SDL_UnlockMutex(pool->mutex);
+    return done;
+}
+
+int job_pool_wait(struct job_pool_t *pool){
+    /* Finishes the batch started by job_pool_start, running its remaining
+    jobs on this thread too. Returns the first error of any job. */
+
+    /* Lend a hand rather than sit idle */
+    job_pool_work(pool, pool->n_threads);
+
+    SDL_LockMutex(pool->mutex);
+    while(SDL_AtomicGet(&pool->n_done) < pool->n || pool->n_busy > 0){
+        SDL_CondWait(pool->done_cond, pool->mutex);
+    }
+    int e = SDL_AtomicGet(&pool->e);
+    pool->fn = NULL;
+    pool->data = NULL;
+    pool->n = 0;
+    SDL_AtomicSet(&pool->n_done, 0);
+    SDL_UnlockMutex(pool->mutex);
+    return e;
+}
+
+int job_pool_run(struct job_pool_t *pool, job_fn_t *fn, void *data, int n){
+    /* Runs fn(data, i) for i in 0 .. n-1 and waits for all of them.
+    If any fail, the rest still run, and the first error is returned. */
+    if(pool == NULL || pool->n_threads == 0){
+        int e = 0;
+        for(int i = 0; i < n; i++){
+            int job_e = fn(data, i);
+            if(job_e && !e)e = job_e;
+        }
+        return e;
+    }
+    if(n == 0)return 0;
+    job_pool_start(pool, fn, data, n);
+    return job_pool_wait(pool);
+}
+
+
+#endif
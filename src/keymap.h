@@ -0,0 +1,191 @@
+#ifndef _KEYMAP_H_
+#define _KEYMAP_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+
+
+/*
+    Which controller keys each keycode is bound to, so a key event goes
+    straight to whoever it's for, rather than being compared against
+    every controller's keycodes.
+
+    A hash table from keycode to a list of bindings, each of which is a
+    key slot (KEY_U etc.) of an owner: whatever the user identifies
+    controllers by (entities_t uses entity_t handles). A keycode can be
+    bound to keys of any number of owners, e.g. two local players
+    sharing a button; looking it up doesn't depend on how many owners or
+    bindings there are in total.
+*/
+
+
+struct keymap_binding_t {
+    Uint32 owner;
+    int key;
+
+    /* next binding of the same keycode, or -1 */
+    int next;
+};
+
+struct keymap_t {
+    /* Open addressing with linear probing: slot s is empty if keycodes[s]
+    is SDLK_UNKNOWN, otherwise heads[s] is the first binding of keycodes[s]
+    (or -1 if it's no longer bound to anything; keycodes keep their slot
+    once they have one). table_size is 0 or a power of 2, at least twice
+    n_keycodes. */
+    int table_size;
+    int n_keycodes;
+    SDL_Keycode *keycodes;
+    int *heads;
+
+    /* bindings 0 .. n_bindings-1 are in use, or on the free list starting
+    at free_binding (-1 if it's empty), linked through their next */
+    int n_bindings;
+    int bindings_cap;
+    struct keymap_binding_t *bindings;
+    int free_binding;
+};
+
+
+
+/**********
+ * KEYMAP *
+ **********/
+
+void keymap_init(struct keymap_t *keymap){
+    memset(keymap, 0, sizeof(*keymap));
+    keymap->free_binding = -1;
+}
+
+void keymap_cleanup(struct keymap_t *keymap){
+    free(keymap->keycodes);
+    free(keymap->heads);
+    free(keymap->bindings);
+    keymap_init(keymap);
+}
+
+int keymap_find_slot(struct keymap_t *keymap, SDL_Keycode keycode){
+    /* Returns keycode's slot, or the empty slot where it would go;
+    table_size mustn't be 0 */
+    int mask = keymap->table_size - 1;
+    int s = (int)(((Uint32)keycode * 2654435761u) >> 8) & mask;
+    while(keymap->keycodes[s] != keycode && keymap->keycodes[s] != SDLK_UNKNOWN){
+        s = (s + 1) & mask;
+    }
+    return s;
+}
+
+int keymap_grow(struct keymap_t *keymap){
+    /* Doubles the table, rehashing the keycodes already in it */
+    int old_size = keymap->table_size;
+    SDL_Keycode *old_keycodes = keymap->keycodes;
+    int *old_heads = keymap->heads;
+
+    int size = old_size == 0? 16: old_size * 2;
+    SDL_Keycode *keycodes = calloc(size, sizeof(*keycodes));
+    int *heads = malloc(sizeof(*heads) * size);
+    if(keycodes == NULL || heads == NULL){
+        free(keycodes);
+        free(heads);
+        return 1;
+    }
+    keymap->table_size = size;
+    keymap->keycodes = keycodes;
+    keymap->heads = heads;
+    for(int s = 0; s < old_size; s++){
+        if(old_keycodes[s] == SDLK_UNKNOWN)continue;
+        int new_s = keymap_find_slot(keymap, old_keycodes[s]);
+        keycodes[new_s] = old_keycodes[s];
+        heads[new_s] = old_heads[s];
+    }
+    free(old_keycodes);
+    free(old_heads);
+    return 0;
+}
+
+int keymap_get(struct keymap_t *keymap, SDL_Keycode keycode){
+    /* Returns the first binding of keycode, or -1 if it has none. Loop
+    over them with:
+        for(int b = keymap_get(keymap, keycode); b >= 0; b = keymap->bindings[b].next)
+    */
+    if(keymap->table_size == 0 || keycode == SDLK_UNKNOWN)return -1;
+    int s = keymap_find_slot(keymap, keycode);
+    return keymap->keycodes[s] == keycode? keymap->heads[s]: -1;
+}
+
+int keymap_bind(struct keymap_t *keymap, SDL_Keycode keycode, Uint32 owner, int key){
+    /* Binds keycode to owner's key */
+    if(keycode == SDLK_UNKNOWN){
+        LOG("Can't bind SDLK_UNKNOWN: owner=%u, key=%i\n", (unsigned int)owner, key);
+        return 2;
+    }
+    if((keymap->n_keycodes + 1) * 2 > keymap->table_size)RET_IF_NZ(keymap_grow(keymap));
+    int s = keymap_find_slot(keymap, keycode);
+    if(keymap->keycodes[s] == SDLK_UNKNOWN){
+        keymap->keycodes[s] = keycode;
+        keymap->heads[s] = -1;
+        keymap->n_keycodes++;
+    }
+
+    int b = keymap->free_binding;
+    if(b >= 0){
+        keymap->free_binding = keymap->bindings[b].next;
+    }else{
+        if(keymap->n_bindings == keymap->bindings_cap){
+            int new_cap = keymap->bindings_cap == 0? 16: keymap->bindings_cap * 2;
+            struct keymap_binding_t *new_bindings = realloc(keymap->bindings, sizeof(*new_bindings) * new_cap);
+            if(new_bindings == NULL)return 1;
+            keymap->bindings = new_bindings;
+            keymap->bindings_cap = new_cap;
+        }
+        b = keymap->n_bindings++;
+    }
+    struct keymap_binding_t *binding = &keymap->bindings[b];
+    binding->owner = owner;
+    binding->key = key;
+    binding->next = keymap->heads[s];
+    keymap->heads[s] = b;
+    return 0;
+}
+
+void keymap_unbind(struct keymap_t *keymap, SDL_Keycode keycode, Uint32 owner, int key){
+    /* Undoes keymap_bind(keymap, keycode, owner, key), if it was done */
+    if(keymap->table_size == 0)return;
+    int s = keymap_find_slot(keymap, keycode);
+    if(keymap->keycodes[s] != keycode)return;
+    for(int *link = &keymap->heads[s]; *link >= 0; link = &keymap->bindings[*link].next){
+        int b = *link;
+        struct keymap_binding_t *binding = &keymap->bindings[b];
+        if(binding->owner != owner || binding->key != key)continue;
+        *link = binding->next;
+        binding->next = keymap->free_binding;
+        keymap->free_binding = b;
+        return;
+    }
+}
+
+void keymap_repr(struct keymap_t *keymap, int depth){
+    if(DEBUG_REPR >= 1){
+        LOG("Dumping keymap: %p\n", keymap);
+    }
+    REPR_FIELD(keymap, n_keycodes, "%i", depth)
+    REPR_FIELD(keymap, table_size, "%i", depth)
+    for(int s = 0; s < keymap->table_size; s++){
+        if(keymap->keycodes[s] == SDLK_UNKNOWN)continue;
+        print_tabs(depth + 1);
+        LOG_RAW("%i:", keymap->keycodes[s]);
+        for(int b = keymap->heads[s]; b >= 0; b = keymap->bindings[b].next){
+            LOG_RAW(" %u/%i", (unsigned int)keymap->bindings[b].owner, keymap->bindings[b].key);
+        }
+        LOG_RAW("\n");
+    }
+}
+
+
+#endif
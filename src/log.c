@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "log.h"
+
+
+/*
+    Ring buffer with a single consumer, the writer thread. Producers
+    (whoever calls log_printf, from any thread) take turns through
+    log_lock, held just long enough to format one message; only they write
+    log_head, and only the writer writes log_tail, so the writer never
+    takes the lock.
+    Both are free-running counters, slot = counter % LOG_SLOTS.
+*/
+
+struct log_slot_t {
+    int len;
+    char text[LOG_SLOT_SIZE];
+};
+
+static struct log_slot_t log_slots[LOG_SLOTS];
+static SDL_atomic_t log_head;
+static SDL_atomic_t log_tail;
+static SDL_atomic_t log_dropped;
+static SDL_atomic_t log_running;
+static SDL_SpinLock log_lock = 0;
+static SDL_Thread *log_thread = NULL;
+
+
+static void log_drain(void){
+    int tail = SDL_AtomicGet(&log_tail);
+    int head = SDL_AtomicGet(&log_head);
+    while(tail != head){
+        struct log_slot_t *slot = &log_slots[(unsigned int)tail & (LOG_SLOTS - 1)];
+        fwrite(slot->text, 1, slot->len, stdout);
+        tail = (int)((unsigned int)tail + 1);
+
+        /* Slot can now be reused by the producer */
+        SDL_AtomicSet(&log_tail, tail);
+    }
+    fflush(stdout);
+}
+
+static int log_writer(void *data){
+    int dropped = 0;
+    while(1){
+        bool running = SDL_AtomicGet(&log_running);
+        log_drain();
+
+        int new_dropped = SDL_AtomicGet(&log_dropped);
+        if(new_dropped != dropped){
+            fprintf(stderr, "Log buffer full: %i messages dropped\n", new_dropped - dropped);
+            dropped = new_dropped;
+        }
+
+        /* Whatever was logged before log_stop has been drained */
+        if(!running)break;
+        SDL_Delay(1);
+    }
+    return 0;
+}
+
+int log_start(void){
+    if(log_thread != NULL)return 0;
+    SDL_AtomicSet(&log_head, 0);
+    SDL_AtomicSet(&log_tail, 0);
+    SDL_AtomicSet(&log_dropped, 0);
+    SDL_AtomicSet(&log_running, 1);
+    log_thread = SDL_CreateThread(log_writer, "log", NULL);
+    if(log_thread == NULL){
+        SDL_AtomicSet(&log_running, 0);
+        fprintf(stderr, "Couldn't start log thread, logging synchronously: %s\n", SDL_GetError());
+        return 2;
+    }
+    return 0;
+}
+
+void log_stop(void){
+    /* Writes out anything still buffered, and stops the writer thread */
+    if(log_thread == NULL)return;
+    SDL_AtomicSet(&log_running, 0);
+    SDL_WaitThread(log_thread, NULL);
+    log_thread = NULL;
+}
+
+void log_printf(const char *func, int line, const char *fmt, ...){
+    va_list args;
+    va_start(args, fmt);
+
+    if(!SDL_AtomicGet(&log_running)){
+        if(func != NULL)printf("%s: %i: ", func, line);
+        vprintf(fmt, args);
+        va_end(args);
+        return;
+    }
+
+    SDL_AtomicLock(&log_lock);
+    int head = SDL_AtomicGet(&log_head);
+    int tail = SDL_AtomicGet(&log_tail);
+    if((unsigned int)head - (unsigned int)tail >= LOG_SLOTS){
+        SDL_AtomicUnlock(&log_lock);
+        SDL_AtomicAdd(&log_dropped, 1);
+        va_end(args);
+        return;
+    }
+
+    struct log_slot_t *slot = &log_slots[(unsigned int)head & (LOG_SLOTS - 1)];
+    int len = 0;
+    if(func != NULL){
+        len = snprintf(slot->text, LOG_SLOT_SIZE, "%s: %i: ", func, line);
+        if(len >= LOG_SLOT_SIZE)len = LOG_SLOT_SIZE - 1;
+    }
+    len += vsnprintf(slot->text + len, LOG_SLOT_SIZE - len, fmt, args);
+    if(len >= LOG_SLOT_SIZE)len = LOG_SLOT_SIZE - 1;
+    slot->len = len;
+    va_end(args);
+
+    /* Publish the slot to the writer thread */
+    SDL_AtomicSet(&log_head, (int)((unsigned int)head + 1));
+    SDL_AtomicUnlock(&log_lock);
+}
@@ -0,0 +1,36 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdbool.h>
+
+
+/*
+    Logging goes through a ring buffer, drained by a writer thread, so
+    that the game loop never waits on stdout. If the buffer is full,
+    messages are dropped (and counted) rather than waiting.
+    Before log_start (or after log_stop), messages are written directly.
+
+    Per-category verbosity is set by the DEBUG_* levels in settings.h:
+        if(DEBUG_RENDER >= 1){
+            LOG("Rendering room: %p\n", room);
+        }
+    ...and since those are constants, disabled logging compiles to nothing.
+*/
+
+/* Max length of one message; longer ones are truncated */
+#define LOG_SLOT_SIZE 256
+
+/* Number of messages the ring buffer holds; must be a power of 2 */
+#define LOG_SLOTS 4096
+
+/* Logs a message prefixed with the calling function & line */
+#define LOG(...) log_printf(__func__, __LINE__, __VA_ARGS__)
+
+/* Logs a message as-is, e.g. for continuing a line */
+#define LOG_RAW(...) log_printf(NULL, 0, __VA_ARGS__)
+
+int log_start(void);
+void log_stop(void);
+void log_printf(const char *func, int line, const char *fmt, ...);
+
+#endif
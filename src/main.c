@@ -8,94 +8,188 @@
 #include "world.h"
 #include "map.h"
 #include "sprite.h"
-
+#include "assets.h"
+#include "profile.h"
+#include "scene.h"
+#include "replay.h"
+
+
+struct world_t *mainloop_load_scene(struct assets_t *assets, const char *scene_fname, entity_t *player){
+    /* Loads a scene (see scene.h) to play as its first non-CPU sprite */
+    struct world_t *world = scene_load(assets, scene_fname);
+    if(world == NULL)return NULL;
+    struct entities_t *entities = world->entities;
+    for(int i = 0; i < entities->n; i++){
+        if(entities->controller[i].is_cpu)continue;
+        *player = entities_get_entity(entities, i);
+        return world;
+    }
+    LOG("Scene has no player (i.e. sprites without \"cpu\"): %s\n", scene_fname);
+    return NULL;
+}
 
 int mainloop(SDL_Renderer *renderer, int n_args, char *args[]){
+    /* Usage: main [SCENE_FNAME [RECORD_FNAME]]
+    Plays data/map0.txt, or a scene; if RECORD_FNAME is given, the
+    scene's input gets recorded there (see replay.h) */
     SDL_Event event;
+    const char *scene_fname = n_args >= 2? args[1]: NULL;
+    const char *record_fname = n_args >= 3? args[2]: NULL;
+
+    struct assets_t *assets = assets_create();
+    if(assets == NULL)return 1;
+    RET_IF_NZ(assets_use_pack(assets, PACK_FNAME));
+    RET_IF_NZ(assets_use_jobs(assets, LOAD_THREADS));
+
+    struct world_t *world;
+    entity_t player;
+    if(scene_fname != NULL){
+        world = mainloop_load_scene(assets, scene_fname, &player);
+        if(world == NULL)return 1;
+    }else{
+        struct map_t *map = map_load(assets, "data/map0.txt");
+        if(map == NULL)return 1;
 
-    struct map_t *map = map_load("data/map0.txt");
-    if(map == NULL)return 1;
-
-    struct world_t *world = world_create(map);
-    if(world == NULL)return 1;
+        world = world_create(map);
+        if(world == NULL)return 1;
 
-    struct sprite_t *player = sprite_load("data/sprites/player.txt", world->room_x, world->room_y, 0, 0, false);
-    if(player == NULL)return 1;
+        struct sprite_t *player_sprite = sprite_load(assets, "data/sprites/player.txt");
+        if(player_sprite == NULL)return 1;
+        RET_IF_NZ(world_spawn(world, player_sprite, 0, 0, false, &player));
+        sprite_destroy(player_sprite, assets);
+    }
+    RET_IF_NZ(world_use_jobs(world, TICK_THREADS));
 
     SDL_Keycode keycodes[KEYS] = {
         SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT,
         SDLK_SPACE
     };
-    controller_set_keycodes(&player->controller, keycodes);
+    RET_IF_NZ(entities_set_keycodes(world->entities, player, keycodes));
+
+    struct replay_writer_t *replay = NULL;
+    if(record_fname != NULL){
+        replay = replay_writer_create(world->entities, scene_fname);
+        if(replay == NULL)return 1;
+    }
+
+    struct profile_t *profile = NULL;
+    if(PROFILE_FRAMES){
+        profile = profile_create();
+        if(profile == NULL)return 1;
+    }
 
-    RET_IF_NZ(world_sprites_add(world, player));
+    LOG("Using assets:\n");
+    assets_repr(assets, 1);
 
-    LOG(); printf("Using world:\n");
+    LOG("Using world:\n");
     world_repr(world, 1);
 
+    /* If the renderer doesn't wait for vsync, we sleep a little each frame
+    rather than spinning */
+    SDL_RendererInfo renderer_info;
+    RET_IF_SDL_ERR(SDL_GetRendererInfo(renderer, &renderer_info));
+    bool vsync = renderer_info.flags & SDL_RENDERER_PRESENTVSYNC;
+
+    /* Fixed timestep: the world ticks every TICK_MS, however long frames
+    take. Time not yet spent on ticks builds up in tick_time. */
+    Uint64 tick_len = SDL_GetPerformanceFrequency() * TICK_MS / 1000;
+    Uint64 tick_time = 0;
+    Uint64 last_time = SDL_GetPerformanceCounter();
+
+    /* PREPARE WORLD FOR ITS FIRST TICK */
+    RET_IF_NZ(world_prepare_tick(world));
+
     bool loop = true;
     while(loop){
 
         /* START TIMER */
-        Uint32 last_tick = SDL_GetTicks();
-        Uint32 next_tick = last_tick + 30;
-
-        /* RENDER WORLD */
-        RET_IF_SDL_ERR(SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE));
-        RET_IF_SDL_ERR(SDL_RenderClear(renderer));
-        RET_IF_NZ(world_render(world, 0, 0, renderer));
-        SDL_RenderPresent(renderer);
-
-        /* PREPARE WORLD FOR A NEW TICK */
-        RET_IF_NZ(world_prepare_tick(world));
+        PROFILE_START(profile, PHASE_FRAME)
+        Uint64 now = SDL_GetPerformanceCounter();
+        tick_time += now - last_time;
+        last_time = now;
 
         /* HANDLE EVENTS */
+        PROFILE_START(profile, PHASE_EVENTS)
         while(SDL_PollEvent(&event)){
             if(event.type == SDL_QUIT){
                 loop = false;
+            }else if(event.type == SDL_RENDER_TARGETS_RESET){
+                /* Contents of target textures were lost */
+                room_layer_clear(world->room);
             }else if(event.type == SDL_KEYDOWN || event.type == SDL_KEYUP){
                 if(event.key.keysym.sym == SDLK_ESCAPE){
                     if(event.type == SDL_KEYDOWN){
                         loop = false;
                     }
+                }else if(PROFILE_FRAMES && event.key.keysym.sym == SDLK_F1){
+                    if(event.type == SDL_KEYDOWN){
+                        profile_dump(profile, stdout);
+                    }
                 }else{
                     /* UPDATE CONTROLLER KEY STATES */
-                    for(int i = 0; i < world->n_sprites; i++){
-                        struct sprite_t *sprite = world->sprites[i];
-                            if(sprite != NULL){
-                            struct controller_t *controller = &sprite->controller;
-                            for(int j = 0; j < KEYS; j++){
-                                if(controller->keycodes[i] == event.key.keysym.sym){
-                                    if(event.type == SDL_KEYDOWN){
-                                        controller->key_is_down[i] = true;
-                                        controller->key_was_down[i] = true;
-                                    }else if(event.type == SDL_KEYUP){
-                                        controller->key_is_down[i] = false;
-                                    }
-                                }
-                            }
-                        }
-                    }
+                    world_handle_key(world, event.key.keysym.sym, event.type == SDL_KEYDOWN);
                 }
             }
         }
 
-        /* DO WHATEVER A WORLD DOES DURING A TICK */
-        RET_IF_NZ(world_do_tick(world));
+        PROFILE_END(profile, PHASE_EVENTS)
 
-        /* DELAY */
-        Uint32 new_tick = SDL_GetTicks();
-        if(new_tick < next_tick){
-            Uint32 wait_ticks = next_tick - new_tick;
-            SDL_Delay(wait_ticks);
+        /* DO AS MANY TICKS AS WE HAVE TIME FOR */
+        int n_ticks = 0;
+        while(tick_time >= tick_len && n_ticks < MAX_CATCHUP_TICKS){
+
+            /* DO WHATEVER A WORLD DOES DURING A TICK */
+            PROFILE_START(profile, PHASE_TICK)
+            if(replay != NULL)RET_IF_NZ(replay_writer_record(replay, world->entities));
+            RET_IF_NZ(world_do_tick(world));
+            PROFILE_END(profile, PHASE_TICK)
+
+            /* PREPARE WORLD FOR A NEW TICK */
+            PROFILE_START(profile, PHASE_PREPARE_TICK)
+            RET_IF_NZ(world_prepare_tick(world));
+            PROFILE_END(profile, PHASE_PREPARE_TICK)
+
+            tick_time -= tick_len;
+            n_ticks++;
+        }
+        if(tick_time >= tick_len){
+            /* We're too far behind to catch up: the game slows down rather
+            than spending every frame on ticks */
+            tick_time %= tick_len;
         }
+        world->tick_alpha = (float)tick_time / tick_len;
 
+        /* RENDER WORLD */
+        PROFILE_START(profile, PHASE_RENDER)
+        RET_IF_SDL_ERR(SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE));
+        RET_IF_SDL_ERR(SDL_RenderClear(renderer));
+        RET_IF_NZ(world_render(world, 0, 0, renderer));
+        PROFILE_END(profile, PHASE_RENDER)
+        PROFILE_START(profile, PHASE_PRESENT)
+        SDL_RenderPresent(renderer);
+        PROFILE_END(profile, PHASE_PRESENT)
+
+        /* DELAY */
+        PROFILE_START(profile, PHASE_DELAY)
+        if(!vsync)SDL_Delay(1);
+        PROFILE_END(profile, PHASE_DELAY)
+        PROFILE_END(profile, PHASE_FRAME)
+
+    }
+
+    if(PROFILE_FRAMES){
+        profile_dump(profile, stdout);
+    }
+    if(replay != NULL){
+        RET_IF_NZ(replay_writer_save(replay, record_fname));
+        replay_writer_destroy(replay);
     }
     return 0;
 }
 
 int main(int n_args, char *args[]){
     int e = 0;
+    log_start();
     if(SDL_Init(SDL_INIT_VIDEO)){
         e = 1;
         fprintf(stderr, "SDL_Init error: %s\n", SDL_GetError());
@@ -109,22 +203,24 @@ int main(int n_args, char *args[]){
             fprintf(stderr, "SDL_CreateWindow error: %s\n", SDL_GetError());
         }else{
             SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
-                SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+                SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC |
+                SDL_RENDERER_TARGETTEXTURE);
 
             if(!renderer){
                 e = 1;
                 fprintf(stderr, "SDL_CreateRenderer error: %s\n", SDL_GetError());
             }else{
                 e = mainloop(renderer, n_args, args);
-                printf("Destroying renderer\n");
+                LOG_RAW("Destroying renderer\n");
                 SDL_DestroyRenderer(renderer);
             }
-            printf("Destroying window\n");
+            LOG_RAW("Destroying window\n");
             SDL_DestroyWindow(window);
         }
-        printf("Quitting SDL\n");
+        LOG_RAW("Quitting SDL\n");
         SDL_Quit();
     }
+    log_stop();
     fprintf(stderr, "Exiting with code: %i\n", e);
     return e;
 }
@@ -9,11 +9,35 @@
 
 #include "settings.h"
 #include "util.h"
+#include "stats.h"
 #include "parse.h"
 #include "pal.h"
 #include "tileset.h"
+#include "framebuffer.h"
+#include "grid.h"
+#include "assets.h"
+#include "jobs.h"
 
 
+struct room_layer_t {
+    /* A room's background pre-rendered into a target texture, so that it
+    can be drawn with a single copy per frame. */
+
+    SDL_Renderer *renderer;
+
+    /* NULL if never built, or if the texture couldn't be created (in which
+    case failed is true, and we fall back to room_render) */
+    SDL_Texture *texture;
+    bool failed;
+
+    /* what the layer was rendered from */
+    struct tileset_t *tileset;
+    struct pal_t *pal;
+    int version;
+    int tileset_version;
+    int pal_version;
+};
+
 struct room_t {
     const char *name;
 
@@ -35,23 +59,50 @@ struct room_t {
     /* room's data is a 2d array of indices into the tileset */
     int w;
     int h;
-    int *data;
+    struct grid_t data;
+
+    /* bumped by room_touch whenever data changes */
+    int version;
+
+    /* see room_get_layer */
+    struct room_layer_t layer;
 };
 
+/* max rooms prefetched at once, see map_prefetch */
+#define MAP_PREFETCH_MAX 4
+
 struct map_t {
     const char *name;
 
     /* filename from which this was loaded */
     const char *fname;
 
-    /* array of rooms */
+    /* where rooms are acquired from (and released to) */
+    struct assets_t *assets;
+
+    /* array of rooms: rooms[i] is loaded from room_fnames[i] the first time
+    map_get_room hands it out, and is NULL until then (or once evicted) */
     int len;
+    char **room_fnames;
     struct room_t **rooms;
 
+    /* value of use_clock when each room was last handed out, so the least
+    recently used can be evicted when resident_size exceeds room_budget */
+    int *room_used;
+    int use_clock;
+    size_t resident_size;
+    size_t room_budget;
+
+    /* rooms being loaded in the background, see map_prefetch: room
+    prefetch_i[i] goes in prefetch_rooms[i] */
+    int n_prefetch;
+    int prefetch_i[MAP_PREFETCH_MAX];
+    struct room_t *prefetch_rooms[MAP_PREFETCH_MAX];
+
     /* map's data is 2d array of indices into its rooms */
     int w;
     int h;
-    int *data;
+    struct grid_t data;
 
     /* coords of initial room */
     int entrance_x;
@@ -65,9 +116,10 @@ struct map_t {
  ********/
 
 struct room_t *room_create(const char *name, const char *fname, struct tileset_t *tileset, struct pal_t *pal, int w, int h){
-    int size = w * h;
     struct room_t *room = malloc(sizeof(*room));
-    LOG(); printf("Creating room: %p, name=%s, fname=%s, tileset=%p, pal=%p, w=%i, h=%i\n", room, fname, name, tileset, pal, w, h);
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating room: %p, name=%s, fname=%s, tileset=%p, pal=%p, w=%i, h=%i\n", room, fname, name, tileset, pal, w, h);
+    }
     if(room == NULL)return room;
     room->name = name;
     room->fname = fname;
@@ -79,15 +131,24 @@ struct room_t *room_create(const char *name, const char *fname, struct tileset_t
     room->offset_s = 0;
     room->offset_e = 0;
     room->offset_w = 0;
-    room->data = size == 0? NULL: malloc(sizeof(*room->data) * size);
-    if(size != 0 && room->data == NULL)return NULL;
-    for(int i = 0; i < size; i++)room->data[i] = -1;
+    room->version = 0;
+    room->layer.renderer = NULL;
+    room->layer.texture = NULL;
+    room->layer.failed = false;
+
+    /* Room is empty, but may be filled with any of tileset's tiles */
+    RET_NULL_IF_NZ(grid_init(&room->data, w, h, tileset == NULL? 0: tileset->len - 1));
     return room;
 }
 
+void room_touch(struct room_t *room){
+    /* Call this after modifying room->data */
+    room->version++;
+}
+
 void room_repr(struct room_t *room, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping room: %p\n", room);
+        LOG("Dumping room: %p\n", room);
     }
 
     REPR_FIELD(room, name, "%s", depth)
@@ -103,65 +164,38 @@ void room_repr(struct room_t *room, int depth){
     REPR_FIELD(room, h, "%i", depth)
 
     REPR_FIELD_MULTI(data, depth)
-    repr_intmap(room->data, room->w, room->h, "%3s", "%3i", depth+1);
+    grid_repr(&room->data, depth+1);
 }
 
 
-struct room_t *room_load(const char *fname){
-    LOG(); printf("Loading room: fname=%s\n", fname);
-    char *fdata = load_file(fname);
-    if(fdata == NULL)return NULL;
+struct room_t *room_load_packed(struct assets_t *assets, struct pack_entry_t *entry, const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading packed room: fname=%s\n", fname);
+    }
+    struct pack_reader_t reader;
+    pack_reader_init(&reader, assets->pack, entry);
+    const char *name = pack_read_string(&reader);
+    const char *tileset_fname = pack_read_string(&reader);
+    const char *pal_fname = pack_read_string(&reader);
+    int offset_n = pack_read_i32(&reader);
+    int offset_s = pack_read_i32(&reader);
+    int offset_e = pack_read_i32(&reader);
+    int offset_w = pack_read_i32(&reader);
+    int w = pack_read_len(&reader);
+    int h = pack_read_len(&reader);
+    /* At least a byte per cell (see pack_read_grid) */
+    pack_reader_has(&reader, (Uint64)w * h);
+    RET_NULL_IF_NZ(pack_reader_check(&reader));
 
-    const char *name = NULL;
-    const char *tileset_fname = NULL;
     struct tileset_t *tileset = NULL;
-    const char *pal_fname = NULL;
+    if(tileset_fname != NULL){
+        tileset = tileset_acquire(assets, tileset_fname);
+        if(tileset == NULL)return NULL;
+    }
     struct pal_t *pal = NULL;
-    int offset_n = 0;
-    int offset_s = 0;
-    int offset_e = 0;
-    int offset_w = 0;
-    int w = 0;
-    int h = 0;
-
-    char *key = NULL;
-    char *val = NULL;
-    int key_len = 0;
-    int val_len = 0;
-    while(1){
-        RET_NULL_IF_NZ(parse_item(&fdata, &key, &key_len, &val, &val_len));
-        if(key_len == 0){
-            LOG(); printf("Parse error: expected key \"data\"\n");
-            return NULL;
-        }
-        if(strncmp(key, "name", key_len) == 0){
-            name = strndup(val, val_len);
-        }else if(strncmp(key, "tileset", key_len) == 0){
-            tileset_fname = strndup(val, val_len);
-            tileset = tileset_load(tileset_fname);
-            if(tileset == NULL)return NULL;
-        }else if(strncmp(key, "palette", key_len) == 0){
-            pal_fname = strndup(val, val_len);
-            pal = pal_load(pal_fname);
-            if(pal == NULL)return NULL;
-        }else if(strncmp(key, "w", key_len) == 0){
-            w = atoi(val);
-        }else if(strncmp(key, "h", key_len) == 0){
-            h = atoi(val);
-        }else if(strncmp(key, "offset_n", key_len) == 0){
-            offset_n = atoi(val);
-        }else if(strncmp(key, "offset_s", key_len) == 0){
-            offset_s = atoi(val);
-        }else if(strncmp(key, "offset_e", key_len) == 0){
-            offset_e = atoi(val);
-        }else if(strncmp(key, "offset_w", key_len) == 0){
-            offset_w = atoi(val);
-        }else if(strncmp(key, "data", key_len) == 0){
-            break;
-        }else{
-            LOG(); printf("Parse error: unexpected key \"%.*s\"\n", key_len, key);
-            return NULL;
-        }
+    if(pal_fname != NULL){
+        pal = pal_acquire(assets, pal_fname);
+        if(pal == NULL)return NULL;
     }
 
     struct room_t *room = room_create(name, fname, tileset, pal, w, h);
@@ -172,20 +206,107 @@ struct room_t *room_load(const char *fname){
     room->offset_e = offset_e;
     room->offset_w = offset_w;
 
-    RET_NULL_IF_NZ(parse_intmap(&fdata, room->data, w, h, 16));
+    grid_cleanup(&room->data);
+    RET_NULL_IF_NZ(pack_read_grid(&reader, &room->data, w, h));
 
     if(DEBUG_LOAD >= 1){
-        LOG(); printf("Loaded room: %p\n", room);
+        LOG("Loaded room: %p\n", room);
         room_repr(room, 1);
     }
 
     return room;
 }
 
+struct room_fields_t {
+    char *name;
+    char *tileset;
+    char *palette;
+    int w;
+    int h;
+    int offset_n;
+    int offset_s;
+    int offset_e;
+    int offset_w;
+};
+
+const struct field_t ROOM_FIELDS[] = {
+    {"name", FIELD_STRING, offsetof(struct room_fields_t, name), false},
+    {"tileset", FIELD_STRING, offsetof(struct room_fields_t, tileset), false},
+    {"palette", FIELD_STRING, offsetof(struct room_fields_t, palette), false},
+    {"w", FIELD_INT, offsetof(struct room_fields_t, w), false},
+    {"h", FIELD_INT, offsetof(struct room_fields_t, h), false},
+    {"offset_n", FIELD_INT, offsetof(struct room_fields_t, offset_n), false},
+    {"offset_s", FIELD_INT, offsetof(struct room_fields_t, offset_s), false},
+    {"offset_e", FIELD_INT, offsetof(struct room_fields_t, offset_e), false},
+    {"offset_w", FIELD_INT, offsetof(struct room_fields_t, offset_w), false},
+    {"data", FIELD_SECTION, 0, true}
+};
+
+struct schema_t ROOM_SCHEMA = SCHEMA("room", ROOM_FIELDS);
+
+struct room_t *room_parse(struct assets_t *assets, struct parser_t *parser, const char *fname){
+    struct room_fields_t fields = {NULL, NULL, NULL, 0, 0, 0, 0, 0, 0};
+    unsigned int seen = 0;
+    const struct field_t *section;
+    RET_NULL_IF_NZ(parse_fields(parser, &ROOM_SCHEMA, &fields, &seen, &section));
+    int w = fields.w;
+    int h = fields.h;
+
+    struct tileset_t *tileset = NULL;
+    if(fields.tileset != NULL){
+        tileset = tileset_acquire(assets, fields.tileset);
+        free(fields.tileset);
+        if(tileset == NULL)return NULL;
+    }
+    struct pal_t *pal = NULL;
+    if(fields.palette != NULL){
+        pal = pal_acquire(assets, fields.palette);
+        free(fields.palette);
+        if(pal == NULL)return NULL;
+    }
+
+    struct room_t *room = room_create(fields.name, fname, tileset, pal, w, h);
+    if(room == NULL)return NULL;
+
+    room->offset_n = fields.offset_n;
+    room->offset_s = fields.offset_s;
+    room->offset_e = fields.offset_e;
+    room->offset_w = fields.offset_w;
+
+    /* Cells are only as wide as the file's largest tile index needs */
+    grid_cleanup(&room->data);
+    RET_NULL_IF_NZ(grid_parse(&room->data, parser, w, h, 16));
+
+    if(DEBUG_LOAD >= 1){
+        LOG("Loaded room: %p\n", room);
+        room_repr(room, 1);
+    }
 
-int room_render(struct room_t *room, int room_x, int room_y, SDL_Renderer *renderer){
+    return room;
+}
+
+struct room_t *room_load(struct assets_t *assets, const char *fname){
+    /* The room's tileset & pal are acquired through assets, so they're
+    shared with any other rooms (or sprites) using the same files */
+    struct pack_entry_t *entry = assets_find_packed(assets, ASSET_ROOM, fname);
+    if(entry != NULL)return room_load_packed(assets, entry, fname);
+
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading room: fname=%s\n", fname);
+    }
+    struct file_view_t file;
+    RET_NULL_IF_NZ(file_view_open(fname, &file));
+    struct parser_t parser;
+    parser_init(&parser, file.data, file.size);
+    struct room_t *room = room_parse(assets, &parser, fname);
+    file_view_close(&file);
+    return room;
+}
+
+
+int room_render(struct room_t *room, int room_x, int room_y, SDL_Renderer *renderer, struct draw_batch_t *batch){
     if(DEBUG_RENDER >= 1){
-        LOG(); printf("Rendering room: %p\n", room);
+        LOG("Rendering room: %p\n", room);
     }
 
     struct tileset_t *tileset = room->tileset;
@@ -201,52 +322,207 @@ int room_render(struct room_t *room, int room_x, int room_y, SDL_Renderer *rende
         int tile_x = room_x;
         for(int j = 0; j < w; j++){
 
-            int tile_i = room->data[i * w + j];
+            int tile_i = grid_get(&room->data, i * w + j);
             if(tile_i >= 0){
-                struct tile_t *tile = &tileset->tiles[tile_i];
-                RET_IF_NZ(tile_render(tile, tile_w, tile_h, tile_x, tile_y, pal, renderer));
+                RET_IF_NZ(tileset_render_tile(tileset, tile_i, tile_x, tile_y, pal, renderer, batch));
             }
 
             tile_x += tile_w * TILE_PIXEL_W;
         }
         tile_y += tile_h * TILE_PIXEL_H;
     }
+    if(batch != NULL)RET_IF_NZ(draw_batch_end_layer(batch, renderer));
+    return 0;
+}
+
+
+void room_render_framebuffer(struct room_t *room, int room_x, int room_y, struct framebuffer_t *fb){
+    struct tileset_t *tileset = room->tileset;
+    struct pal_t *pal = room->pal;
+
+    int w = room->w;
+    int h = room->h;
+    int tile_w = tileset->tile_w;
+    int tile_h = tileset->tile_h;
+
+    int tile_y = room_y;
+    for(int i = 0; i < h; i++){
+        int tile_x = room_x;
+        for(int j = 0; j < w; j++){
+            int tile_i = grid_get(&room->data, i * w + j);
+            if(tile_i >= 0){
+                framebuffer_render_tile(fb, &tileset->tiles[tile_i], tile_w, tile_h, tile_x, tile_y, pal);
+            }
+            tile_x += tile_w * TILE_PIXEL_W;
+        }
+        tile_y += tile_h * TILE_PIXEL_H;
+    }
+}
+
+void room_layer_clear(struct room_t *room){
+    /* Frees room's pre-rendered layer; it will be rebuilt the next time it's
+    asked for. Call this if the renderer loses its target textures, or to
+    free the memory of a room we're no longer in. */
+    struct room_layer_t *layer = &room->layer;
+    if(layer->texture != NULL)SDL_DestroyTexture(layer->texture);
+    layer->renderer = NULL;
+    layer->texture = NULL;
+    layer->failed = false;
+}
+
+int room_layer_build(struct room_t *room, SDL_Renderer *renderer, struct draw_batch_t *batch){
+    struct room_layer_t *layer = &room->layer;
+    struct tileset_t *tileset = room->tileset;
+    int layer_w = room->w * tileset->tile_w * TILE_PIXEL_W;
+    int layer_h = room->h * tileset->tile_h * TILE_PIXEL_H;
+
+    if(DEBUG_RENDER >= 1){
+        LOG("Building room layer: %p, w=%i, h=%i\n", room, layer_w, layer_h);
+    }
+
+    if(layer->texture != NULL && layer->tileset != tileset){
+        /* Tile size may have changed, and with it the layer size */
+        SDL_DestroyTexture(layer->texture);
+        layer->texture = NULL;
+    }
+    if(layer->texture == NULL){
+        layer->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_TARGET, layer_w, layer_h);
+        if(layer->texture == NULL){
+            LOG("Couldn't create room layer, falling back to room_render: %s\n", SDL_GetError());
+            layer->failed = true;
+            return 0;
+        }
+        RET_IF_SDL_ERR(SDL_SetTextureBlendMode(layer->texture, SDL_BLENDMODE_BLEND));
+    }
+    layer->renderer = renderer;
+
+    /* Render the room into the layer, with empty cells left transparent */
+    SDL_Texture *old_target = SDL_GetRenderTarget(renderer);
+    RET_IF_SDL_ERR(SDL_SetRenderTarget(renderer, layer->texture));
+    RET_IF_SDL_ERR(SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_TRANSPARENT));
+    RET_IF_SDL_ERR(SDL_RenderClear(renderer));
+    RENDER_STAT(1, layer_w * layer_h)
+    int e = room_render(room, 0, 0, renderer, batch);
+    if(!e && batch != NULL)e = draw_batch_flush(batch, renderer);
+    RET_IF_SDL_ERR(SDL_SetRenderTarget(renderer, old_target));
+    if(e)return e;
+
+    layer->tileset = tileset;
+    layer->pal = room->pal;
+    layer->version = room->version;
+    layer->tileset_version = tileset->version;
+    layer->pal_version = room->pal->version;
+    return 0;
+}
+
+bool room_layer_is_stale(struct room_t *room, SDL_Renderer *renderer){
+    struct room_layer_t *layer = &room->layer;
+    return layer->texture == NULL ||
+        layer->renderer != renderer ||
+        layer->tileset != room->tileset ||
+        layer->pal != room->pal ||
+        layer->version != room->version ||
+        layer->tileset_version != room->tileset->version ||
+        layer->pal_version != room->pal->version;
+}
+
+int room_render_layer(struct room_t *room, int room_x, int room_y, SDL_Renderer *renderer, struct draw_batch_t *batch){
+    /* Renders room from its pre-rendered layer with a single copy,
+    (re)building the layer first if anything it depends on has changed.
+    Falls back to room_render if target textures aren't supported. */
+    struct room_layer_t *layer = &room->layer;
+
+    if(layer->renderer != renderer){
+        /* The texture belongs to another renderer (or there is none) */
+        room_layer_clear(room);
+    }
+    if(!layer->failed && room_layer_is_stale(room, renderer)){
+        RET_IF_NZ(room_layer_build(room, renderer, batch));
+    }
+    if(layer->failed){
+        return room_render(room, room_x, room_y, renderer, batch);
+    }
+
+    SDL_Rect dst = {room_x, room_y, 0, 0};
+    dst.w = room->w * room->tileset->tile_w * TILE_PIXEL_W;
+    dst.h = room->h * room->tileset->tile_h * TILE_PIXEL_H;
+    RET_IF_SDL_ERR(SDL_RenderCopy(renderer, layer->texture, NULL, &dst));
+    RENDER_STAT(1, dst.w * dst.h)
     return 0;
 }
 
+void room_destroy(struct room_t *room, struct assets_t *assets){
+    /* Frees room, releasing its tileset & pal */
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying room: %p\n", room);
+    }
+    room_layer_clear(room);
+    if(room->tileset != NULL)assets_release(assets, room->tileset);
+    if(room->pal != NULL)assets_release(assets, room->pal);
+    grid_cleanup(&room->data);
+    free(room);
+}
+
+void *room_asset_load(struct assets_t *assets, const char *fname){
+    return room_load(assets, fname);
+}
+
+void room_asset_destroy(struct assets_t *assets, void *data){
+    room_destroy(data, assets);
+}
+
+struct room_t *room_acquire(struct assets_t *assets, const char *fname){
+    /* Loads fname through assets, see assets_acquire.
+    Give the room back with assets_release. */
+    return assets_acquire(assets, ASSET_ROOM, fname, room_asset_load, room_asset_destroy);
+}
+
 
 
 /*******
  * MAP *
  *******/
 
-struct map_t *map_create(const char *name, const char *fname, int len, int w, int h){
-    int size = w * h;
+struct map_t *map_create(struct assets_t *assets, const char *name, const char *fname, int len, int w, int h){
     struct map_t *map = malloc(sizeof(*map));
-    LOG(); printf("Creating map: %p, name=%s, fname=%s, len=%i, w=%i, h=%i\n", map, name, fname, len, w, h);
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating map: %p, name=%s, fname=%s, len=%i, w=%i, h=%i\n", map, name, fname, len, w, h);
+    }
     if(map == NULL)return map;
     map->name = name;
     map->fname = fname;
+    map->assets = assets;
     map->len = len;
     map->w = w;
     map->h = h;
     map->entrance_x = 0;
     map->entrance_y = 0;
+    map->use_clock = 0;
+    map->resident_size = 0;
+    map->room_budget = MAP_ROOM_BUDGET;
+    map->n_prefetch = 0;
 
+    map->room_fnames = len == 0? NULL: malloc(sizeof(*map->room_fnames) * len);
+    if(len != 0 && map->room_fnames == NULL)return NULL;
     map->rooms = len == 0? NULL: malloc(sizeof(*map->rooms) * len);
     if(len != 0 && map->rooms == NULL)return NULL;
-    for(int i = 0; i < len; i++)map->rooms[i] = NULL;
+    map->room_used = len == 0? NULL: malloc(sizeof(*map->room_used) * len);
+    if(len != 0 && map->room_used == NULL)return NULL;
+    for(int i = 0; i < len; i++){
+        map->room_fnames[i] = NULL;
+        map->rooms[i] = NULL;
+        map->room_used[i] = 0;
+    }
 
-    map->data = size == 0? NULL: malloc(sizeof(*map->data) * size);
-    if(size != 0 && map->data == NULL)return NULL;
-    for(int i = 0; i < size; i++)map->data[i] = -1;
+    RET_NULL_IF_NZ(grid_init(&map->data, w, h, len - 1));
 
     return map;
 }
 
 void map_repr(struct map_t *map, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping map: %p\n", map);
+        LOG("Dumping map: %p\n", map);
     }
 
     REPR_FIELD(map, name, "%s", depth)
@@ -259,109 +535,346 @@ void map_repr(struct map_t *map, int depth){
     REPR_FIELD(map, entrance_x, "%i", depth)
     REPR_FIELD(map, entrance_y, "%i", depth)
 
+    REPR_FIELD(map, resident_size, "%zu", depth)
+    REPR_FIELD(map, room_budget, "%zu", depth)
+
     REPR_FIELD_MULTI(rooms, depth)
     for(int i = 0; i < map->len; i++){
         print_tabs(depth + 1);
-        printf(map->rooms[i]->fname);
-        printf("\n");
+        LOG_RAW("%s%s\n", map->room_fnames[i], map->rooms[i] == NULL? "": " (loaded)");
     }
 
     REPR_FIELD_MULTI(data, depth)
-    repr_intmap(map->data, map->w, map->h, "%3s", "%3i", depth+1);
+    grid_repr(&map->data, depth+1);
+}
+
+int map_init_schemas(){
+    /* Schemas are initialized on first use, which mustn't happen on
+    several threads at once, so do it before loading rooms on workers */
+    RET_IF_NZ(schema_init(&ROOM_SCHEMA));
+    RET_IF_NZ(schema_init(&TILESET_SCHEMA));
+    RET_IF_NZ(schema_init(&TILE_SCHEMA));
+    RET_IF_NZ(schema_init(&PAL_SCHEMA));
+    return 0;
 }
 
+size_t room_get_size(struct room_t *room){
+    /* Roughly how much memory room holds by itself; its tileset & pal are
+    shared, so they aren't counted */
+    return sizeof(*room) + grid_get_size(&room->data);
+}
 
-struct map_t *map_load(const char *fname){
-    LOG(); printf("Loading map: fname=%s\n", fname);
-    char *fdata = load_file(fname);
-    if(fdata == NULL)return NULL;
+void map_add_room(struct map_t *map, int room_i, struct room_t *room){
+    /* Makes room (to which we own a reference) resident as room_i */
+    map->rooms[room_i] = room;
+    map->resident_size += room_get_size(room);
+}
 
-    const char *name = NULL;
-    int len = 0;
-    int w = 0;
-    int h = 0;
-    int entrance_x = 0;
-    int entrance_y = 0;
+void map_evict_room(struct map_t *map, int room_i){
+    /* Releases our reference to room_i. Anything else holding a reference
+    (e.g. world->room) keeps the room alive, and if it's needed again, it's
+    re-acquired without being reloaded. */
+    struct room_t *room = map->rooms[room_i];
+    if(DEBUG_LOAD >= 1){
+        LOG("Evicting room: %p, room_i=%i, fname=%s\n", room, room_i, map->room_fnames[room_i]);
+    }
+    map->resident_size -= room_get_size(room);
+    map->rooms[room_i] = NULL;
+    assets_release(map->assets, room);
+}
 
+void map_evict(struct map_t *map, int keep_i){
+    /* Evicts least recently used rooms until we're within budget, except
+    keep_i (pass -1 to not keep any) */
+    while(map->resident_size > map->room_budget){
+        int lru_i = -1;
+        for(int i = 0; i < map->len; i++){
+            if(i == keep_i || map->rooms[i] == NULL)continue;
+            if(lru_i < 0 || map->room_used[i] < map->room_used[lru_i])lru_i = i;
+        }
+        if(lru_i < 0)break;
+        map_evict_room(map, lru_i);
+    }
+}
+
+int map_rooms_job(void *data, int i){
+    struct map_t *map = data;
+    if(map->rooms[i] != NULL)return 0;
+    struct room_t *room = room_acquire(map->assets, map->room_fnames[i]);
+    if(room == NULL)return 2;
+    map->rooms[i] = room;
+    return 0;
+}
+
+int map_prefetch_job(void *data, int i){
+    struct map_t *map = data;
+    struct room_t *room = room_acquire(map->assets, map->room_fnames[map->prefetch_i[i]]);
+    map->prefetch_rooms[i] = room;
+    return room == NULL? 2: 0;
+}
+
+void map_finish_prefetch(struct map_t *map){
+    /* Waits for rooms being prefetched, and makes them resident */
+    if(map->n_prefetch == 0)return;
+    if(job_pool_wait(map->assets->jobs)){
+        /* No matter: whichever failed will be tried again if needed */
+        LOG("Couldn't prefetch all rooms of map: %s\n", map->fname);
+    }
+    for(int i = 0; i < map->n_prefetch; i++){
+        struct room_t *room = map->prefetch_rooms[i];
+        if(room == NULL)continue;
+        int room_i = map->prefetch_i[i];
+        if(map->rooms[room_i] != NULL){
+            /* map_get_room needed it before we got here */
+            assets_release(map->assets, room);
+            continue;
+        }
+        map_add_room(map, room_i, room);
+        map->room_used[room_i] = map->use_clock;
+    }
+    map->n_prefetch = 0;
+    map_evict(map, -1);
+}
+
+void map_poll_prefetch(struct map_t *map){
+    /* Makes prefetched rooms resident if they're done loading, without
+    waiting if they're not */
+    if(map->n_prefetch == 0)return;
+    if(job_pool_is_done(map->assets->jobs))map_finish_prefetch(map);
+}
+
+int map_prefetch(struct map_t *map, int x, int y){
+    /*
+        Starts loading the rooms next to (x, y) on assets' job pool, so
+        that they're ready by the time we walk into them; if there's no
+        pool, they're left to be loaded on demand.
+        Loading rooms only parses & allocates: textures are created the
+        first time they're rendered, on the main thread.
+    */
+    struct job_pool_t *jobs = map->assets->jobs;
+    if(jobs == NULL || jobs->n_threads == 0)return 0;
+
+    /* The pool only runs one batch at a time */
+    map_finish_prefetch(map);
+
+    const int dirs[4][2] = {{0, -1}, {0, 1}, {1, 0}, {-1, 0}};
+    int n = 0;
+    for(int dir = 0; dir < 4; dir++){
+        int room_x = x + dirs[dir][0];
+        int room_y = y + dirs[dir][1];
+        if(room_x < 0 || room_x >= map->w || room_y < 0 || room_y >= map->h)continue;
+        int room_i = grid_get(&map->data, room_y * map->w + room_x);
+        if(room_i < 0 || room_i >= map->len || map->rooms[room_i] != NULL)continue;
+
+        bool dup = false;
+        for(int i = 0; i < n; i++)dup |= map->prefetch_i[i] == room_i;
+        if(dup)continue;
+        map->prefetch_i[n] = room_i;
+        map->prefetch_rooms[n] = NULL;
+        n++;
+    }
+    if(n == 0)return 0;
+
+    RET_IF_NZ(map_init_schemas());
+    map->n_prefetch = n;
+    job_pool_start(jobs, map_prefetch_job, map, n);
+    return 0;
+}
+
+int map_load_all_rooms(struct map_t *map){
+    /* Makes every room resident at once, regardless of room_budget (e.g.
+    for baking), loading them in parallel if assets has a job pool */
+    map_finish_prefetch(map);
+    if(map->assets->jobs != NULL)RET_IF_NZ(map_init_schemas());
+    RET_IF_NZ(job_pool_run(map->assets->jobs, map_rooms_job, map, map->len));
+    map->resident_size = 0;
+    for(int i = 0; i < map->len; i++){
+        map->resident_size += room_get_size(map->rooms[i]);
+        map->room_used[i] = map->use_clock;
+    }
+    return 0;
+}
+
+
+struct map_t *map_load_packed(struct assets_t *assets, struct pack_entry_t *entry, const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading packed map: fname=%s\n", fname);
+    }
+    struct pack_reader_t reader;
+    pack_reader_init(&reader, assets->pack, entry);
+    const char *name = pack_read_string(&reader);
+    int len = pack_read_len(&reader);
+    int w = pack_read_len(&reader);
+    int h = pack_read_len(&reader);
+    int entrance_x = pack_read_i32(&reader);
+    int entrance_y = pack_read_i32(&reader);
+    pack_reader_has(&reader, (Uint64)len * 4 + (Uint64)w * h);
+    RET_NULL_IF_NZ(pack_reader_check(&reader));
+
+    struct map_t *map = map_create(assets, name, fname, len, w, h);
+    if(map == NULL)return NULL;
+    map->entrance_x = entrance_x;
+    map->entrance_y = entrance_y;
+
+    for(int i = 0; i < len; i++){
+        const char *room_fname = pack_read_string(&reader);
+        if(room_fname == NULL)reader.failed = true;
+        RET_NULL_IF_NZ(pack_reader_check(&reader));
+        map->room_fnames[i] = strndup(room_fname, strlen(room_fname));
+        if(map->room_fnames[i] == NULL)return NULL;
+    }
+
+    grid_cleanup(&map->data);
+    RET_NULL_IF_NZ(pack_read_grid(&reader, &map->data, w, h));
+
+    if(DEBUG_LOAD >= 1){
+        LOG("Loaded map: %p\n", map);
+        map_repr(map, 1);
+    }
+
+    return map;
+}
+
+struct map_fields_t {
+    char *name;
+    int len;
+    int w;
+    int h;
+    int entrance_x;
+    int entrance_y;
+};
+
+const struct field_t MAP_FIELDS[] = {
+    {"name", FIELD_STRING, offsetof(struct map_fields_t, name), false},
+    {"len", FIELD_INT, offsetof(struct map_fields_t, len), false},
+    {"w", FIELD_INT, offsetof(struct map_fields_t, w), false},
+    {"h", FIELD_INT, offsetof(struct map_fields_t, h), false},
+    {"entrance_x", FIELD_INT, offsetof(struct map_fields_t, entrance_x), false},
+    {"entrance_y", FIELD_INT, offsetof(struct map_fields_t, entrance_y), false},
+    {"rooms", FIELD_SECTION, 0, false},
+    {"data", FIELD_SECTION, 0, false}
+};
+
+struct schema_t MAP_SCHEMA = SCHEMA("map", MAP_FIELDS);
+
+struct map_t *map_parse(struct assets_t *assets, struct parser_t *parser, const char *fname){
+    struct map_fields_t fields = {NULL, 0, 0, 0, 0, 0};
+    unsigned int seen = 0;
     struct map_t *map = NULL;
 
-    char *key = NULL;
-    char *val = NULL;
-    int key_len = 0;
-    int val_len = 0;
     while(1){
-        RET_NULL_IF_NZ(parse_item(&fdata, &key, &key_len, &val, &val_len));
-        if(key_len == 0)break;
-
-        if(map == NULL && (
-            strncmp(key, "rooms", key_len) == 0 ||
-            strncmp(key, "data", key_len) == 0
-        )){
-            map = map_create(name, fname, len, w, h);
+        const struct field_t *section;
+        RET_NULL_IF_NZ(parse_fields(parser, &MAP_SCHEMA, &fields, &seen, &section));
+        if(section == NULL)break;
+
+        /* The map's size must be known by its first section */
+        if(map == NULL){
+            map = map_create(assets, fields.name, fname, fields.len, fields.w, fields.h);
             if(map == NULL)return NULL;
         }
 
-        if(strncmp(key, "name", key_len) == 0){
-            name = strndup(val, val_len);
-        }else if(strncmp(key, "len", key_len) == 0){
-            len = atoi(val);
-        }else if(strncmp(key, "w", key_len) == 0){
-            w = atoi(val);
-        }else if(strncmp(key, "h", key_len) == 0){
-            h = atoi(val);
-        }else if(strncmp(key, "entrance_x", key_len) == 0){
-            entrance_x = atoi(val);
-        }else if(strncmp(key, "entrance_y", key_len) == 0){
-            entrance_y = atoi(val);
-        }else if(strncmp(key, "rooms", key_len) == 0){
-            for(int i = 0; i < len; i++){
-                char *room_fname = NULL;
-                int room_fname_len = 0;
-                RET_NULL_IF_NZ(parse_string(&fdata, &room_fname, &room_fname_len));
-                struct room_t *room = room_load(strndup(room_fname, room_fname_len));
-                if(room == NULL)return NULL;
-                map->rooms[i] = room;
+        if(strcmp(section->key, "rooms") == 0){
+            for(int i = 0; i < map->len; i++){
+                struct str_t line;
+                RET_NULL_IF_NZ(parse_string(parser, &line));
+                map->room_fnames[i] = str_dup(line);
+                if(map->room_fnames[i] == NULL)return NULL;
             }
-        }else if(strncmp(key, "data", key_len) == 0){
-            RET_NULL_IF_NZ(parse_intmap(&fdata, map->data, w, h, 10));
         }else{
-            LOG(); printf("Parse error: unexpected key \"%.*s\"\n", key_len, key);
-            return NULL;
+            grid_cleanup(&map->data);
+            RET_NULL_IF_NZ(grid_parse(&map->data, parser, map->w, map->h, 10));
         }
     }
 
     if(map == NULL){
-        LOG(); printf("Parse error: missing key \"rooms\" or \"data\"\n");
+        LOG("Parse error: missing key \"rooms\" or \"data\"\n");
         return NULL;
     }
+    for(int i = 0; i < map->len; i++){
+        if(map->room_fnames[i] == NULL){
+            LOG("Parse error: missing key \"rooms\"\n");
+            return NULL;
+        }
+    }
 
-    map->entrance_x = entrance_x;
-    map->entrance_y = entrance_y;
+    map->entrance_x = fields.entrance_x;
+    map->entrance_y = fields.entrance_y;
 
     if(DEBUG_LOAD >= 1){
-        LOG(); printf("Loaded map: %p\n", map);
+        LOG("Loaded map: %p\n", map);
         map_repr(map, 1);
     }
 
     return map;
 }
 
+struct map_t *map_load(struct assets_t *assets, const char *fname){
+    /* Only the list of rooms is loaded here; the rooms themselves are
+    loaded when first needed, see map_get_room. They're acquired through
+    assets, so a room file listed several times is only loaded once,
+    and its entries share it. */
+    struct pack_entry_t *entry = assets_find_packed(assets, ASSET_MAP, fname);
+    if(entry != NULL)return map_load_packed(assets, entry, fname);
+
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading map: fname=%s\n", fname);
+    }
+    struct file_view_t file;
+    RET_NULL_IF_NZ(file_view_open(fname, &file));
+    struct parser_t parser;
+    parser_init(&parser, file.data, file.size);
+    struct map_t *map = map_parse(assets, &parser, fname);
+    file_view_close(&file);
+    return map;
+}
+
+void map_destroy(struct map_t *map, struct assets_t *assets){
+    /* Frees map, releasing its rooms */
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying map: %p\n", map);
+    }
+    map_finish_prefetch(map);
+    for(int i = 0; i < map->len; i++){
+        if(map->rooms[i] != NULL)assets_release(assets, map->rooms[i]);
+        free(map->room_fnames[i]);
+    }
+    free(map->room_fnames);
+    free(map->rooms);
+    free(map->room_used);
+    grid_cleanup(&map->data);
+    free(map);
+}
+
 struct room_t *map_get_room(struct map_t *map, int x, int y, bool allow_out_of_range){
+    /* Returns the room at (x, y), loading it if it isn't resident.
+    It stays valid until the next call, unless the caller holds its own
+    reference to it (see assets_retain), since rooms may be evicted. */
     int w = map->w;
     int h = map->h;
     if(!allow_out_of_range && (
         x < 0 || x >= w || y < 0 || y >= h
     )){
-        LOG(); printf("Coordinates out of range: x=%i, y=%i, w=%i, h=%i\n", x, y, w, h);
+        LOG("Coordinates out of range: x=%i, y=%i, w=%i, h=%i\n", x, y, w, h);
         return NULL;
     }
-    int room_i = map->data[y * w + x];
+    int room_i = grid_get(&map->data, y * w + x);
     if(room_i < 0)return NULL;
-    if(room_i > map->len){
-        LOG(); printf("Index out of range: room_i=%i, len=%i\n", room_i, map->len);
+    if(room_i >= map->len){
+        LOG("Index out of range: room_i=%i, len=%i\n", room_i, map->len);
         return NULL;
     }
-    return map->rooms[room_i];
+
+    map_poll_prefetch(map);
+    struct room_t *room = map->rooms[room_i];
+    if(room == NULL){
+        /* If it's still being prefetched, assets has us wait for it */
+        room = room_acquire(map->assets, map->room_fnames[room_i]);
+        if(room == NULL)return NULL;
+        map_add_room(map, room_i, room);
+    }
+    map->room_used[room_i] = ++map->use_clock;
+    map_evict(map, room_i);
+    return room;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,331 @@
+#ifndef _PACK_H_
+#define _PACK_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+
+
+/*
+    An asset pack is a single binary file holding any number of maps,
+    rooms, tilesets, pals & sprites, baked from their text formats by
+    tools/bake.c. Loading from a pack means reading a few fixed-width
+    fields and copying arrays out, with no text parsing.
+
+    Every integer is 32 bits, little-endian, and 4-byte aligned.
+    Layout:
+
+        header: "VPAK", version, n_entries, offset of entry table
+        entry table: n_entries of (type, path, offset, size)
+        ...entry data & strings
+
+    An entry's type is one of asset_type_e, its path is the canonical path
+    of the text file it was baked from, and offset & size locate its data.
+    Strings are NUL-terminated, and referred to by their offset in the
+    pack; 0 means NULL.
+
+    Entry data, by type:
+
+        ASSET_PAL: name, len, then len colors as r, g, b, a bytes
+        ASSET_TILESET: name, tile_w, tile_h, len, then for each tile,
+            its pixels then its mask, as bytes (see tile_t)
+        ASSET_ROOM: name, tileset path, pal path,
+            offset_n, offset_s, offset_e, offset_w, w, h, then its grid
+        ASSET_MAP: name, len, w, h, entrance_x, entrance_y,
+            then len room paths, then its grid
+        ASSET_SPRITE: name, tileset path
+
+    Grids are written by pack_write_grid: cell size, then the cells.
+*/
+
+
+#define PACK_MAGIC "VPAK"
+
+/* Bump this whenever the layout changes; packs of other versions are
+rejected, and must be re-baked */
+#define PACK_VERSION 2
+
+#define PACK_HEADER_SIZE 16
+#define PACK_ENTRY_SIZE 16
+
+struct pack_entry_t {
+    Uint32 type;
+    Uint32 path;
+    Uint32 offset;
+    Uint32 size;
+};
+
+struct pack_t {
+    /* filename from which this was loaded */
+    const char *fname;
+
+    /* the whole file, mapped */
+    struct file_view_t file;
+    const Uint8 *data;
+    Uint32 size;
+
+    /* decoded & validated copy of the entry table */
+    int n_entries;
+    struct pack_entry_t *entries;
+};
+
+struct pack_reader_t {
+    /* Reads the fields of one entry in order. Reading past the entry's
+    end (or following a bad string offset) sets failed, and reads 0s from
+    then on; check with pack_reader_check when done. */
+
+    struct pack_t *pack;
+    struct pack_entry_t *entry;
+    Uint32 pos;
+    Uint32 end;
+    bool failed;
+};
+
+struct pack_writer_t {
+    /* Growable buffer a pack is written to, see tools/bake.c */
+
+    Uint8 *data;
+    Uint32 size;
+    Uint32 cap;
+};
+
+
+
+/********
+ * PACK *
+ ********/
+
+Uint32 pack_decode_u32(const Uint8 *p){
+    return (Uint32)p[0] | (Uint32)p[1] << 8 | (Uint32)p[2] << 16 | (Uint32)p[3] << 24;
+}
+
+const char *pack_get_string(struct pack_t *pack, Uint32 offset, bool *ok){
+    /* Returns the string at offset, or NULL for offset 0. Sets *ok to
+    false if offset is out of range or the string isn't terminated. */
+    if(offset == 0)return NULL;
+    if(offset >= pack->size || memchr(pack->data + offset, '\0', pack->size - offset) == NULL){
+        *ok = false;
+        return NULL;
+    }
+    return (const char *)pack->data + offset;
+}
+
+struct pack_t *pack_load(const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading pack: fname=%s\n", fname);
+    }
+    struct pack_t *pack = malloc(sizeof(*pack));
+    if(pack == NULL)return NULL;
+    pack->fname = fname;
+
+    /* The pack stays mapped for as long as it's in use, since loaded
+    assets point into it (e.g. for names) */
+    RET_NULL_IF_NZ(file_view_open(fname, &pack->file));
+    if(pack->file.size < PACK_HEADER_SIZE || pack->file.size > 0x7fffffff){
+        LOG("Pack error: bad size: %s (%lu bytes)\n", fname, (unsigned long)pack->file.size);
+        return NULL;
+    }
+    pack->data = (const Uint8 *)pack->file.data;
+    pack->size = pack->file.size;
+
+    const Uint8 *header = pack->data;
+    if(memcmp(header, PACK_MAGIC, 4) != 0){
+        LOG("Pack error: not a pack: %s\n", fname);
+        return NULL;
+    }
+    Uint32 version = pack_decode_u32(header + 4);
+    if(version != PACK_VERSION){
+        LOG("Pack error: version %u, expected %i (re-bake it): %s\n", version, PACK_VERSION, fname);
+        return NULL;
+    }
+    Uint32 n_entries = pack_decode_u32(header + 8);
+    Uint32 entries_offset = pack_decode_u32(header + 12);
+    if(entries_offset > pack->size || n_entries > (pack->size - entries_offset) / PACK_ENTRY_SIZE){
+        LOG("Pack error: entry table out of range: %s\n", fname);
+        return NULL;
+    }
+
+    pack->n_entries = n_entries;
+    pack->entries = n_entries == 0? NULL: malloc(sizeof(*pack->entries) * n_entries);
+    if(n_entries != 0 && pack->entries == NULL)return NULL;
+    for(Uint32 i = 0; i < n_entries; i++){
+        const Uint8 *p = pack->data + entries_offset + i * PACK_ENTRY_SIZE;
+        struct pack_entry_t *entry = &pack->entries[i];
+        entry->type = pack_decode_u32(p);
+        entry->path = pack_decode_u32(p + 4);
+        entry->offset = pack_decode_u32(p + 8);
+        entry->size = pack_decode_u32(p + 12);
+
+        bool ok = true;
+        const char *path = pack_get_string(pack, entry->path, &ok);
+        if(!ok || path == NULL ||
+            entry->offset > pack->size || entry->size > pack->size - entry->offset
+        ){
+            LOG("Pack error: entry %u out of range: %s\n", i, fname);
+            return NULL;
+        }
+    }
+
+    if(DEBUG_LOAD >= 1){
+        LOG("Loaded pack: %p, n_entries=%i\n", pack, pack->n_entries);
+    }
+    return pack;
+}
+
+struct pack_entry_t *pack_find(struct pack_t *pack, int type, const char *path){
+    /* Returns the entry of the given type baked from path (which should be
+    canonical, see assets_canonical_path), or NULL if there isn't one */
+    for(int i = 0; i < pack->n_entries; i++){
+        struct pack_entry_t *entry = &pack->entries[i];
+        if(entry->type == (Uint32)type &&
+            strcmp((const char *)pack->data + entry->path, path) == 0
+        )return entry;
+    }
+    return NULL;
+}
+
+
+/***************
+ * PACK READER *
+ ***************/
+
+void pack_reader_init(struct pack_reader_t *reader, struct pack_t *pack, struct pack_entry_t *entry){
+    reader->pack = pack;
+    reader->entry = entry;
+    reader->pos = entry->offset;
+    reader->end = entry->offset + entry->size;
+    reader->failed = false;
+}
+
+bool pack_reader_has(struct pack_reader_t *reader, Uint64 n_bytes){
+    /* Checks the entry has n_bytes left, e.g. before allocating an array
+    whose length we just read */
+    if(reader->failed || n_bytes > reader->end - reader->pos){
+        reader->failed = true;
+        return false;
+    }
+    return true;
+}
+
+int pack_read_i32(struct pack_reader_t *reader){
+    if(!pack_reader_has(reader, 4))return 0;
+    Uint32 value = pack_decode_u32(reader->pack->data + reader->pos);
+    reader->pos += 4;
+    return (Sint32)value;
+}
+
+int pack_read_len(struct pack_reader_t *reader){
+    /* Like pack_read_i32, but for lengths, so negative values are errors */
+    int len = pack_read_i32(reader);
+    if(len < 0){
+        reader->failed = true;
+        return 0;
+    }
+    return len;
+}
+
+const char *pack_read_string(struct pack_reader_t *reader){
+    Uint32 offset = pack_read_i32(reader);
+    bool ok = true;
+    const char *s = pack_get_string(reader->pack, offset, &ok);
+    if(!ok)reader->failed = true;
+    return s;
+}
+
+void pack_read_bytes(struct pack_reader_t *reader, Uint8 *data, int n){
+    if(!pack_reader_has(reader, n))return;
+    memcpy(data, reader->pack->data + reader->pos, n);
+    reader->pos += (n + 3) & ~3;
+    if(reader->pos > reader->end)reader->pos = reader->end;
+}
+
+void pack_read_i32s(struct pack_reader_t *reader, int *data, int n){
+    if(!pack_reader_has(reader, (Uint64)n * 4))return;
+    const Uint8 *p = reader->pack->data + reader->pos;
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    /* Already in our byte order */
+    memcpy(data, p, (size_t)n * 4);
+#else
+    for(int i = 0; i < n; i++)data[i] = (Sint32)pack_decode_u32(p + i * 4);
+#endif
+    reader->pos += n * 4;
+}
+
+int pack_reader_check(struct pack_reader_t *reader){
+    if(reader->failed){
+        LOG("Pack error: entry truncated or corrupt: %s in %s\n",
+            reader->pack->data + reader->entry->path, reader->pack->fname);
+        return 2;
+    }
+    return 0;
+}
+
+
+/***************
+ * PACK WRITER *
+ ***************/
+
+void pack_writer_init(struct pack_writer_t *writer){
+    writer->data = NULL;
+    writer->size = 0;
+    writer->cap = 0;
+}
+
+int pack_writer_reserve(struct pack_writer_t *writer, Uint32 n){
+    if(writer->size + n <= writer->cap)return 0;
+    Uint32 cap = writer->cap == 0? 4096: writer->cap;
+    while(cap < writer->size + n)cap *= 2;
+    Uint8 *data = realloc(writer->data, cap);
+    if(data == NULL)return 1;
+    writer->data = data;
+    writer->cap = cap;
+    return 0;
+}
+
+void pack_encode_u32(Uint8 *p, Uint32 value){
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+int pack_write_i32(struct pack_writer_t *writer, int value){
+    RET_IF_NZ(pack_writer_reserve(writer, 4));
+    pack_encode_u32(writer->data + writer->size, (Uint32)value);
+    writer->size += 4;
+    return 0;
+}
+
+int pack_write_i32s(struct pack_writer_t *writer, int *data, int n){
+    for(int i = 0; i < n; i++)RET_IF_NZ(pack_write_i32(writer, data[i]));
+    return 0;
+}
+
+int pack_write_bytes(struct pack_writer_t *writer, const Uint8 *data, int n){
+    /* Writes n bytes, padded to a multiple of 4 */
+    int padded_n = (n + 3) & ~3;
+    RET_IF_NZ(pack_writer_reserve(writer, padded_n));
+    memcpy(writer->data + writer->size, data, n);
+    for(int i = n; i < padded_n; i++)writer->data[writer->size + i] = 0;
+    writer->size += padded_n;
+    return 0;
+}
+
+int pack_write_string(struct pack_writer_t *writer, const char *s, Uint32 *offset){
+    /* Writes s (if not NULL), and sets *offset to what entries should use
+    to refer to it */
+    if(s == NULL){
+        *offset = 0;
+        return 0;
+    }
+    *offset = writer->size;
+    return pack_write_bytes(writer, (const Uint8 *)s, strlen(s) + 1);
+}
+
+
+#endif
@@ -10,6 +10,7 @@
 #include "settings.h"
 #include "util.h"
 #include "parse.h"
+#include "assets.h"
 
 
 struct pal_t {
@@ -21,6 +22,13 @@ struct pal_t {
     /* palette owns its colors */
     int len;
     SDL_Color *colors;
+
+    /* colors pre-packed as ARGB8888, kept up to date by pal_touch */
+    Uint32 *argb;
+
+    /* bumped by pal_touch whenever colors change, so that anything
+    rasterized from this palette (e.g. tile caches) knows it's stale */
+    int version;
 };
 
 
@@ -39,27 +47,58 @@ void pal_color_init(SDL_Color *c, Uint8 r, Uint8 g, Uint8 b){
 
 void pal_color_repr(SDL_Color *c, int depth){
     print_tabs(depth);
-    printf("%3i %3i %3i\n", c->r, c->g, c->b);
+    LOG_RAW("%3i %3i %3i\n", c->r, c->g, c->b);
+}
+
+Uint32 pal_color_pack(SDL_Color *c){
+    return ((Uint32)c->a << 24) | ((Uint32)c->r << 16) | ((Uint32)c->g << 8) | c->b;
+}
+
+void pal_pack_colors(struct pal_t *pal){
+    for(int i = 0; i < pal->len; i++){
+        pal->argb[i] = pal_color_pack(&pal->colors[i]);
+    }
 }
 
 struct pal_t *pal_create(const char *name, const char *fname, int len){
     struct pal_t *pal = malloc(sizeof(*pal));
-    LOG(); printf("Creating pal: %p, name=%s, fname=%s, len=%i\n", pal, name, fname, len);
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating pal: %p, name=%s, fname=%s, len=%i\n", pal, name, fname, len);
+    }
     if(pal == NULL)return NULL;
     pal->name = name;
     pal->fname = fname;
     pal->len = len;
+    pal->version = 0;
     pal->colors = len == 0? NULL: malloc(sizeof(*pal->colors) * len);
     if(len != 0 && pal->colors == NULL)return NULL;
+    pal->argb = len == 0? NULL: malloc(sizeof(*pal->argb) * len);
+    if(len != 0 && pal->argb == NULL)return NULL;
     for(int i = 0; i < len; i++){
         pal_color_init(&pal->colors[i], 0, 0, 0);
     }
+    pal_pack_colors(pal);
     return pal;
 }
 
+void pal_destroy(struct pal_t *pal){
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying pal: %p\n", pal);
+    }
+    free(pal->colors);
+    free(pal->argb);
+    free(pal);
+}
+
+void pal_touch(struct pal_t *pal){
+    /* Call this after modifying pal->colors */
+    pal_pack_colors(pal);
+    pal->version++;
+}
+
 void pal_repr(struct pal_t *pal, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping pal: %p\n", pal);
+        LOG("Dumping pal: %p\n", pal);
     }
     REPR_FIELD(pal, name, "%s", depth)
     REPR_FIELD(pal, len, "%i", depth)
@@ -69,54 +108,109 @@ void pal_repr(struct pal_t *pal, int depth){
     }
 }
 
-struct pal_t *pal_load(const char *fname){
-    LOG(); printf("Loading pal: fname=%s\n", fname);
-    char *fdata = load_file(fname);
-    if(fdata == NULL)return NULL;
-
-    const char *name = "";
-    int len = 0;
-
-    char *key = NULL;
-    char *val = NULL;
-    int key_len = 0;
-    int val_len = 0;
-    while(1){
-        RET_NULL_IF_NZ(parse_item(&fdata, &key, &key_len, &val, &val_len));
-        if(key_len == 0){
-            LOG(); printf("Parse error: expected key \"colors\"\n");
-            return NULL;
-        }
-        if(strncmp(key, "name", key_len) == 0){
-            name = strndup(val, val_len);
-        }else if(strncmp(key, "len", key_len) == 0){
-            len = atoi(val);
-        }else if(strncmp(key, "colors", key_len) == 0){
-            break;
-        }else{
-            LOG(); printf("Parse error: unexpected key \"%.*s\"\n", key_len, key);
-            return NULL;
-        }
-    }
+struct pal_fields_t {
+    char *name;
+    int len;
+};
 
-    struct pal_t *pal = pal_create(name, fname, len);
+const struct field_t PAL_FIELDS[] = {
+    {"name", FIELD_STRING, offsetof(struct pal_fields_t, name), false},
+    {"len", FIELD_INT, offsetof(struct pal_fields_t, len), false},
+    {"colors", FIELD_SECTION, 0, true}
+};
+
+struct schema_t PAL_SCHEMA = SCHEMA("pal", PAL_FIELDS);
+
+struct pal_t *pal_parse(struct parser_t *parser, const char *fname){
+    struct pal_fields_t fields = {"", 0};
+    unsigned int seen = 0;
+    const struct field_t *section;
+    RET_NULL_IF_NZ(parse_fields(parser, &PAL_SCHEMA, &fields, &seen, &section));
+    int len = fields.len;
+
+    struct pal_t *pal = pal_create(fields.name, fname, len);
     if(pal == NULL)return NULL;
 
     int *data = malloc(sizeof(*data) * len * 3);
     if(data == NULL)return NULL;
-    RET_NULL_IF_NZ(parse_intmap(&fdata, data, 3, len, 10));
+    RET_NULL_IF_NZ(parse_intmap(parser, data, 3, len, 10));
     for(int i = 0; i < len; i++){
         int i3 = i * 3;
         pal_color_init(&pal->colors[i], data[i3 + 0], data[i3 + 1], data[i3 + 2]);
     }
+    free(data);
+    pal_pack_colors(pal);
 
     if(DEBUG_LOAD >= 1){
-        LOG(); printf("Loaded pal: %p\n", pal);
+        LOG("Loaded pal: %p\n", pal);
         pal_repr(pal, 1);
     }
 
     return pal;
 }
 
+struct pal_t *pal_load(const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading pal: fname=%s\n", fname);
+    }
+    struct file_view_t file;
+    RET_NULL_IF_NZ(file_view_open(fname, &file));
+    struct parser_t parser;
+    parser_init(&parser, file.data, file.size);
+    struct pal_t *pal = pal_parse(&parser, fname);
+
+    /* Anything worth keeping was copied out of the file */
+    file_view_close(&file);
+    return pal;
+}
+
+struct pal_t *pal_load_packed(struct pack_t *pack, struct pack_entry_t *entry, const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading packed pal: fname=%s\n", fname);
+    }
+    struct pack_reader_t reader;
+    pack_reader_init(&reader, pack, entry);
+    const char *name = pack_read_string(&reader);
+    int len = pack_read_len(&reader);
+    pack_reader_has(&reader, (Uint64)len * 4);
+    RET_NULL_IF_NZ(pack_reader_check(&reader));
+
+    struct pal_t *pal = pal_create(name, fname, len);
+    if(pal == NULL)return NULL;
+
+    for(int i = 0; i < len; i++){
+        Uint8 rgba[4];
+        pack_read_bytes(&reader, rgba, 4);
+        SDL_Color *c = &pal->colors[i];
+        pal_color_init(c, rgba[0], rgba[1], rgba[2]);
+        c->a = rgba[3];
+    }
+    RET_NULL_IF_NZ(pack_reader_check(&reader));
+    pal_pack_colors(pal);
+
+    if(DEBUG_LOAD >= 1){
+        LOG("Loaded pal: %p\n", pal);
+        pal_repr(pal, 1);
+    }
+
+    return pal;
+}
+
+void *pal_asset_load(struct assets_t *assets, const char *fname){
+    struct pack_entry_t *entry = assets_find_packed(assets, ASSET_PAL, fname);
+    if(entry != NULL)return pal_load_packed(assets->pack, entry, fname);
+    return pal_load(fname);
+}
+
+void pal_asset_destroy(struct assets_t *assets, void *data){
+    pal_destroy(data);
+}
+
+struct pal_t *pal_acquire(struct assets_t *assets, const char *fname){
+    /* Loads fname through assets, see assets_acquire.
+    Give the pal back with assets_release. */
+    return assets_acquire(assets, ASSET_PAL, fname, pal_asset_load, pal_asset_destroy);
+}
+
 
 #endif
\ No newline at end of file
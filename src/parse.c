@@ -10,50 +10,56 @@
 #include "parse.h"
 
 
-void parse_whitespace(char **fdata, bool eat_comments, bool eat_newlines){
+void parser_init(struct parser_t *parser, const char *data, size_t size){
+    parser->pos = data;
+    parser->end = data + size;
+}
+
+void parse_whitespace(struct parser_t *parser, bool eat_comments, bool eat_newlines){
+    const char *end = parser->end;
     char c = '\0';
     do{
         /* EAT WHITESPACE */
-        while(c = *(*fdata), c != '\0' && (eat_newlines || c != '\n') && isspace(c)){
-            (*fdata)++;
+        while(parser->pos < end && (c = *parser->pos, (eat_newlines || c != '\n') && isspace((unsigned char)c))){
+            parser->pos++;
         }
+        if(parser->pos >= end)return;
 
         /* EAT COMMENT */
         if(eat_comments && c == '#'){
-            while(c = *(*fdata), c != '\n' && c != '\0'){
-                (*fdata)++;
+            while(parser->pos < end && (c = *parser->pos) != '\n'){
+                parser->pos++;
             }
         }
-    }while(eat_newlines && c == '\n');
+    }while(eat_newlines && parser->pos < end && c == '\n');
 }
 
-int parse_string(char **fdata, char **val, int *val_len){
+int parse_string(struct parser_t *parser, struct str_t *val){
     /*
         The value goes right to the newline: all whitespace and '#'
         comments will be included in the value!
         TODO: add support for trailing whitespace & comments?..
     */
 
-    char c = '\0';
+    const char *end = parser->end;
 
     /* EAT WHITESPACE */
-    parse_whitespace(fdata, true, true);
+    parse_whitespace(parser, true, true);
 
     /* PARSE STRING TO NEWLINE */
-    *val = *fdata;
-    *val_len = 0;
-    while(c = *(*fdata), c != '\0' && c != '\n'){
-        (*val_len)++;
-        (*fdata)++;
+    val->s = parser->pos;
+    while(parser->pos < end && *parser->pos != '\n'){
+        parser->pos++;
     }
-    if(c != '\0'){
-        (*fdata)++;
+    val->len = parser->pos - val->s;
+    if(parser->pos < end){
+        parser->pos++;
     }
 
     return 0;
 }
 
-int parse_item(char **fdata, char **key, int *key_len, char **val, int *val_len){
+int parse_item(struct parser_t *parser, struct str_t *key, struct str_t *val){
     /*
         Parses one "item", i.e. key/value pair.
         The expected format is:
@@ -64,51 +70,51 @@ int parse_item(char **fdata, char **key, int *key_len, char **val, int *val_len)
         newline: all whitespace and '#' comments will be included in it!
     */
 
-    char c = '\0';
-    *key = NULL;
-    *val = NULL;
-    *key_len = 0;
-    *val_len = 0;
+    const char *end = parser->end;
+    key->s = NULL;
+    key->len = 0;
+    val->s = NULL;
+    val->len = 0;
 
     /* EAT WHITESPACE */
-    parse_whitespace(fdata, true, true);
+    parse_whitespace(parser, true, true);
 
     /* PARSE KEY TO '=' */
-    *key = *fdata;
-    while(c = *(*fdata), c == '_' || isalpha(c)){
-        (*key_len)++;
-        (*fdata)++;
+    key->s = parser->pos;
+    while(parser->pos < end && (*parser->pos == '_' || isalpha((unsigned char)*parser->pos))){
+        parser->pos++;
     }
+    key->len = parser->pos - key->s;
 
-    if(*key_len == 0){
+    if(key->len == 0){
         /* No key: so we're at end of file. That's fine: we return success.
         Caller should know that an empty key means end of file. */
         return 0;
-    }else if(c != '='){
-        LOG(); printf("Parse error: expected '='\n");
-        printf("\n----\n%s\n----\n", *fdata);
+    }else if(parser->pos >= end || *parser->pos != '='){
+        LOG("Parse error: expected '='\n");
+        LOG_RAW("\n----\n%.*s\n----\n", (int)(end - parser->pos < 256? end - parser->pos: 256), parser->pos);
         return 2;
     }
-    (*fdata)++;
+    parser->pos++;
 
     /* PARSE VAL TO NEWLINE */
-    *val = *fdata;
-    while(c = *(*fdata), c != '\0' && c != '\n'){
-        (*val_len)++;
-        (*fdata)++;
+    val->s = parser->pos;
+    while(parser->pos < end && *parser->pos != '\n'){
+        parser->pos++;
     }
-    if(c != '\0'){
-        (*fdata)++;
+    val->len = parser->pos - val->s;
+    if(parser->pos < end){
+        parser->pos++;
     }
 
     if(DEBUG_PARSE >= 1){
-        LOG(); printf("Parsed: %.*s=%.*s\n", *key_len, *key, *val_len, *val);
+        LOG("Parsed: %.*s=%.*s\n", key->len, key->s, val->len, val->s);
     }
 
     return 0;
 }
 
-int parse_intmap(char **fdata, int *data, int w, int h, int base){
+int parse_intmap(struct parser_t *parser, int *data, int w, int h, int base){
     /*
         Parses a 2d map of non-negative integers, e.g.:
             0 1 2
@@ -120,64 +126,221 @@ int parse_intmap(char **fdata, int *data, int w, int h, int base){
         decimal.
     */
 
+    const char *end = parser->end;
     char c = '\0';
 
     /* EAT WHITESPACE */
-    parse_whitespace(fdata, true, true);
+    parse_whitespace(parser, true, true);
 
     for(int i = 0; i < h; i++){
         for(int j = 0; j < w; j++){
 
             /* EAT WHITESPACE ON THIS LINE */
-            parse_whitespace(fdata, false, false);
+            parse_whitespace(parser, false, false);
+            if(parser->pos >= end){
+                LOG("Parse error: unexpected end of file\n");
+                return 2;
+            }
 
             /* PARSE AN INT */
             int n = 0;
-            if(*(*fdata) == '.'){
+            if(*parser->pos == '.'){
                 /* The special character */
                 n = -1;
-                (*fdata)++;
+                parser->pos++;
             }else{
-                while(c = *(*fdata), !isspace(c)){
+                while(parser->pos < end && (c = *parser->pos, !isspace((unsigned char)c))){
                     int digit = 0;
                     if(c >= '0' && c <= '9'){
                         digit = c - '0';
                     }else if(c >= 'A' && c <= 'Z'){
                         digit = c - 'A' + 10;
                     }else{
-                        LOG(); printf("Parse error: expected [.0-9A-Z]\n");
+                        LOG("Parse error: expected [.0-9A-Z]\n");
                         return 2;
                     }
                     n *= base;
                     n += digit;
-                    (*fdata)++;
+                    parser->pos++;
                 }
             }
             if(DEBUG_PARSE >= 2){
-                LOG(); printf("Parsed: %i\n", n);
+                LOG("Parsed: %i\n", n);
             }
             *data = n;
             data++;
         }
 
         /* EAT WHITESPACE */
-        parse_whitespace(fdata, true, true);
+        parse_whitespace(parser, true, true);
+    }
+
+    return 0;
+}
+
+
+unsigned int schema_hash(const char *s, int len, unsigned int seed){
+    /* FNV-1a, with the seed mixed into its offset basis */
+    unsigned int h = 2166136261u ^ seed;
+    for(int i = 0; i < len; i++){
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int schema_init(struct schema_t *schema){
+    /*
+        Finds a seed for which all of schema's keys hash to different
+        slots of its table, i.e. a perfect hash, so that looking up a key
+        is one hash & one comparison.
+        C99 can't compute this at compile time, so it's done the first
+        time the schema is used (hence, call this before sharing a schema
+        between threads). Does nothing if already done.
+    */
+    if(schema->table_size != 0)return 0;
+
+    int n_fields = schema->n_fields;
+    if(n_fields > SCHEMA_MAX_FIELDS){
+        LOG("Too many fields in schema: %s, n_fields=%i, max=%i\n", schema->name, n_fields, SCHEMA_MAX_FIELDS);
+        return 2;
+    }
+
+    /* Start with a table at least twice the number of keys, and grow it
+    if no seed works */
+    int table_size = 1;
+    while(table_size < n_fields * 2)table_size *= 2;
+    for(; table_size <= SCHEMA_TABLE_SIZE; table_size *= 2){
+        for(unsigned int seed = 0; seed < 10000; seed++){
+            bool ok = true;
+            for(int i = 0; i < table_size; i++)schema->table[i] = -1;
+            for(int i = 0; ok && i < n_fields; i++){
+                const char *key = schema->fields[i].key;
+                int slot = schema_hash(key, strlen(key), seed) & (table_size - 1);
+                if(schema->table[slot] >= 0)ok = false;
+                else schema->table[slot] = i;
+            }
+            if(ok){
+                schema->seed = seed;
+                schema->table_size = table_size;
+                if(DEBUG_PARSE >= 1){
+                    LOG("Initialized schema: %s, seed=%u, table_size=%i\n", schema->name, seed, table_size);
+                }
+                return 0;
+            }
+        }
     }
 
+    LOG("Couldn't find a perfect hash for schema: %s\n", schema->name);
+    return 2;
+}
+
+const struct field_t *schema_find(struct schema_t *schema, struct str_t key){
+    /* Returns the field with the given key, or NULL if there isn't one.
+    Only exact matches count. */
+    unsigned int h = schema_hash(key.s, key.len, schema->seed);
+    int i = schema->table[h & (schema->table_size - 1)];
+    if(i < 0)return NULL;
+    const struct field_t *field = &schema->fields[i];
+    return str_eq(key, field->key)? field: NULL;
+}
+
+int parse_fields(struct parser_t *parser, struct schema_t *schema, void *obj, unsigned int *seen, const struct field_t **section){
+    /*
+        Parses items, storing each value in obj as described by the
+        schema's matching field, until either:
+            * a FIELD_SECTION key, which is returned in *section, so the
+              caller can parse whatever follows it (and then call this
+              again, to carry on);
+            * or the end of file, in which case *section is NULL.
+        Every field parsed gets its bit (1 << its index) set in *seen,
+        which the caller should initialize to 0. At end of file, all
+        required fields must have been seen.
+    */
+    RET_IF_NZ(schema_init(schema));
+    *section = NULL;
+
+    struct str_t key;
+    struct str_t val;
+    while(1){
+        RET_IF_NZ(parse_item(parser, &key, &val));
+        if(key.len == 0)break;
+
+        const struct field_t *field = schema_find(schema, key);
+        if(field == NULL){
+            LOG("Parse error: unexpected key \"%.*s\" in %s\n", key.len, key.s, schema->name);
+            return 2;
+        }
+        *seen |= 1u << (field - schema->fields);
+
+        char *value = (char *)obj + field->offset;
+        if(field->type == FIELD_INT){
+            *(int *)value = str_to_int(val);
+        }else if(field->type == FIELD_STRING){
+            char *s = str_dup(val);
+            if(s == NULL)return 1;
+            *(char **)value = s;
+        }else{
+            *section = field;
+            return 0;
+        }
+    }
+
+    for(int i = 0; i < schema->n_fields; i++){
+        const struct field_t *field = &schema->fields[i];
+        if(field->required && !(*seen & 1u << i)){
+            LOG("Parse error: expected key \"%s\" in %s\n", field->key, schema->name);
+            return 2;
+        }
+    }
     return 0;
 }
 
 
+bool str_eq(struct str_t str, const char *s){
+    /* Whether str is exactly s (not just a prefix of it) */
+    return strncmp(str.s, s, str.len) == 0 && s[str.len] == '\0';
+}
+
+int str_to_int(struct str_t str){
+    /* Like atoi, but stops at the end of str: leading whitespace, an
+    optional sign, then as many digits as there are */
+    int i = 0;
+    while(i < str.len && isspace((unsigned char)str.s[i]))i++;
+    bool negative = false;
+    if(i < str.len && (str.s[i] == '-' || str.s[i] == '+')){
+        negative = str.s[i] == '-';
+        i++;
+    }
+    int n = 0;
+    while(i < str.len && str.s[i] >= '0' && str.s[i] <= '9'){
+        n = n * 10 + (str.s[i] - '0');
+        i++;
+    }
+    return negative? -n: n;
+}
+
+char *str_dup(struct str_t str){
+    /* Returns a NUL-terminated copy of str, e.g. for keeping a name after
+    the file it was parsed from is closed */
+    char *s = malloc(str.len + 1);
+    if(s == NULL)return NULL;
+    memcpy(s, str.s, str.len);
+    s[str.len] = '\0';
+    return s;
+}
+
+
 void repr_intmap(int *data, int w, int h, const char *fmt_s, const char *fmt_i, int depth){
     for(int i = 0; i < h; i++){
         print_tabs(depth);
         for(int j = 0; j < w; j++){
             int data_i = data[i * w + j];
-            if(data_i == -1)printf(fmt_s, ".");
-            else printf(fmt_i, data_i);
-            printf(" ");
+            if(data_i == -1)LOG_RAW(fmt_s, ".");
+            else LOG_RAW(fmt_i, data_i);
+            LOG_RAW(" ");
         }
-        printf("\n");
+        LOG_RAW("\n");
     }
 }
 
@@ -1,11 +1,82 @@
 #ifndef _PARSE_H_
 #define _PARSE_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 
-void parse_whitespace(char **fdata, bool eat_comments, bool eat_newlines);
-int parse_string(char **fdata, char **val, int *val_len);
-int parse_item(char **fdata, char **key, int *key_len, char **val, int *val_len);
-int parse_intmap(char **fdata, int *data, int w, int h, int base);
+
+/* A string view: len chars starting at s, not NUL-terminated */
+struct str_t {
+    const char *s;
+    int len;
+};
+
+/* Where we're at in a buffer being parsed, and where it ends. Nothing at
+or past end is ever read, so buffers needn't be NUL-terminated. */
+struct parser_t {
+    const char *pos;
+    const char *end;
+};
+
+/* Field types, see field_t */
+enum field_type_e {
+    FIELD_INT, /* an int, parsed like atoi */
+    FIELD_STRING, /* a char *, copied out of the file */
+    FIELD_SECTION /* no value: what follows is for the caller to parse */
+};
+
+struct field_t {
+    /* One key of a schema, and where its value goes */
+
+    const char *key;
+    int type;
+
+    /* offset of the value within the struct being parsed into (see
+    offsetof); unused for FIELD_SECTION */
+    size_t offset;
+
+    /* if true, parse_fields fails if the file ends without this key */
+    bool required;
+};
+
+/* Max fields per schema; they're tracked as bits of an unsigned int */
+#define SCHEMA_MAX_FIELDS 32
+
+/* Max size of a schema's hash table */
+#define SCHEMA_TABLE_SIZE 128
+
+struct schema_t {
+    /* The keys a file format may contain, see parse_fields */
+
+    /* what's being parsed, for error messages */
+    const char *name;
+
+    int n_fields;
+    const struct field_t *fields;
+
+    /* Perfect hash of the fields' keys: a key with hash h can only be
+    fields[table[h & (table_size - 1)]] (or nothing, if that's -1).
+    Filled in by schema_init; table_size is 0 until then. */
+    unsigned int seed;
+    int table_size;
+    signed char table[SCHEMA_TABLE_SIZE];
+};
+
+/* Initializer for a schema_t, given a name & an array of fields */
+#define SCHEMA(name, fields) {(name), sizeof(fields) / sizeof(*(fields)), (fields), 0, 0, {0}}
+
+
+void parser_init(struct parser_t *parser, const char *data, size_t size);
+void parse_whitespace(struct parser_t *parser, bool eat_comments, bool eat_newlines);
+int parse_string(struct parser_t *parser, struct str_t *val);
+int parse_item(struct parser_t *parser, struct str_t *key, struct str_t *val);
+int parse_intmap(struct parser_t *parser, int *data, int w, int h, int base);
+int schema_init(struct schema_t *schema);
+const struct field_t *schema_find(struct schema_t *schema, struct str_t key);
+int parse_fields(struct parser_t *parser, struct schema_t *schema, void *obj, unsigned int *seen, const struct field_t **section);
+bool str_eq(struct str_t str, const char *s);
+int str_to_int(struct str_t str);
+char *str_dup(struct str_t str);
 void repr_intmap(int *data, int w, int h, const char *fmt_s, const char *fmt_i, int depth);
 
 
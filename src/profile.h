@@ -0,0 +1,137 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "settings.h"
+#include "util.h"
+
+
+/* Phases of a frame, timed separately by the profiler */
+enum profile_phase_e {
+    PHASE_RENDER,
+    PHASE_PRESENT,
+    PHASE_PREPARE_TICK,
+    PHASE_EVENTS,
+    PHASE_TICK,
+    PHASE_DELAY,
+    PHASE_FRAME,
+    PHASES
+};
+
+const char *PROFILE_PHASE_NAMES[PHASES] = {
+    "render",
+    "present",
+    "prepare_tick",
+    "events",
+    "tick",
+    "delay",
+    "frame"
+};
+
+/* Histogram buckets are PROFILE_BUCKET_NS wide; anything past the last
+one lands in it (but still counts towards max) */
+#define PROFILE_BUCKET_NS 100000
+#define PROFILE_BUCKETS 1000
+
+struct profile_histogram_t {
+    Uint32 counts[PROFILE_BUCKETS];
+    Uint32 n;
+    Uint64 total_ns;
+    Uint64 max_ns;
+};
+
+struct profile_t {
+    /* Per-phase frame timing, see PROFILE_START/PROFILE_END */
+
+    Uint64 freq;
+    Uint64 start[PHASES];
+    struct profile_histogram_t histograms[PHASES];
+};
+
+
+/* When PROFILE_FRAMES is 0, these compile to nothing */
+#define PROFILE_START(profile, phase) {if(PROFILE_FRAMES){profile_start(profile, phase);}}
+#define PROFILE_END(profile, phase) {if(PROFILE_FRAMES){profile_end(profile, phase);}}
+
+
+
+/***********
+ * PROFILE *
+ ***********/
+
+void profile_reset(struct profile_t *profile){
+    for(int i = 0; i < PHASES; i++){
+        struct profile_histogram_t *histogram = &profile->histograms[i];
+        for(int j = 0; j < PROFILE_BUCKETS; j++)histogram->counts[j] = 0;
+        histogram->n = 0;
+        histogram->total_ns = 0;
+        histogram->max_ns = 0;
+        profile->start[i] = 0;
+    }
+}
+
+struct profile_t *profile_create(){
+    struct profile_t *profile = malloc(sizeof(*profile));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating profile: %p\n", profile);
+    }
+    if(profile == NULL)return NULL;
+    profile->freq = SDL_GetPerformanceFrequency();
+    profile_reset(profile);
+    return profile;
+}
+
+void profile_start(struct profile_t *profile, int phase){
+    profile->start[phase] = SDL_GetPerformanceCounter();
+}
+
+void profile_end(struct profile_t *profile, int phase){
+    Uint64 ticks = SDL_GetPerformanceCounter() - profile->start[phase];
+    Uint64 ns = ticks * 1000000000 / profile->freq;
+    struct profile_histogram_t *histogram = &profile->histograms[phase];
+    Uint64 bucket = ns / PROFILE_BUCKET_NS;
+    if(bucket >= PROFILE_BUCKETS)bucket = PROFILE_BUCKETS - 1;
+    histogram->counts[bucket]++;
+    histogram->n++;
+    histogram->total_ns += ns;
+    if(ns > histogram->max_ns)histogram->max_ns = ns;
+}
+
+double profile_histogram_percentile(struct profile_histogram_t *histogram, double percentile){
+    /* Returns (the upper edge of the bucket containing) the given
+    percentile, in milliseconds */
+    if(histogram->n == 0)return 0;
+    Uint64 target = (Uint64)(histogram->n * percentile / 100.0);
+    Uint64 seen = 0;
+    for(int i = 0; i < PROFILE_BUCKETS; i++){
+        seen += histogram->counts[i];
+        if(seen > target){
+            if(i == PROFILE_BUCKETS - 1)break;
+            double ms = (i + 1) * (PROFILE_BUCKET_NS / 1e6);
+            double max_ms = histogram->max_ns / 1e6;
+            return ms < max_ms? ms: max_ms;
+        }
+    }
+    return histogram->max_ns / 1e6;
+}
+
+void profile_dump(struct profile_t *profile, FILE *f){
+    fprintf(f, "%-14s %8s %9s %9s %9s %9s %9s\n",
+        "phase (ms)", "n", "mean", "p50", "p95", "p99", "max");
+    for(int i = 0; i < PHASES; i++){
+        struct profile_histogram_t *histogram = &profile->histograms[i];
+        double mean = histogram->n == 0? 0: histogram->total_ns / 1e6 / histogram->n;
+        fprintf(f, "%-14s %8u %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+            PROFILE_PHASE_NAMES[i], histogram->n, mean,
+            profile_histogram_percentile(histogram, 50),
+            profile_histogram_percentile(histogram, 95),
+            profile_histogram_percentile(histogram, 99),
+            histogram->max_ns / 1e6);
+    }
+}
+
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+#include "pack.h"
+#include "entities.h"
+
+
+/*
+    Input logs: each tick's key states of the entities which aren't
+    CPU-controlled, recorded during play (see main.c) and replayed into
+    world_do_tick without a window or real input (see bench/sim.c).
+    Ticks are deterministic, so replaying a log in the scene it was
+    recorded in reproduces the session exactly.
+
+    Layout (integers little-endian, as in packs):
+
+        header: "VREC", version, n_ticks, n_entities
+        scene fname: its length, then its bytes, padded to 4 bytes
+        n_entities entity_t handles
+        ...ticks
+
+    An entity's state for a tick is key_is_down | key_was_down << 8, and
+    what's stored is its XOR with the entity's previous state (0 before
+    the first tick), so keys held down or left alone cost nothing. Ticks
+    are a sequence of varints (7 bits per byte, low bits first, top bit
+    set on all but the last byte):
+
+        n << 1: n ticks in which no state changed
+        n << 1 | 1: one tick in which n states changed, followed by n
+            pairs: how many entities (in handle order) were skipped since
+            the previous change; and the XOR of the state
+*/
+
+
+#define REPLAY_MAGIC "VREC"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 16
+
+struct replay_writer_t {
+    /* the scene being played, see scene_load */
+    const char *scene_fname;
+
+    /* handles of the entities being recorded, & their last states */
+    int n_entities;
+    entity_t *entities;
+    Uint16 *states;
+
+    int n_ticks;
+
+    /* ticks not yet written, since none of their states changed */
+    int n_unchanged;
+
+    /* header & everything recorded so far */
+    struct pack_writer_t writer;
+};
+
+struct replay_reader_t {
+    /* filename from which this was loaded */
+    const char *fname;
+
+    const char *scene_fname;
+
+    int n_entities;
+    entity_t *entities;
+    Uint16 *states;
+
+    int n_ticks;
+    int tick;
+
+    /* ticks left of the current run of unchanged ones */
+    int n_unchanged;
+
+    /* the whole file, & where the next tick starts; reading past its
+    end sets failed */
+    struct file_view_t file;
+    const Uint8 *data;
+    size_t size;
+    size_t pos;
+    bool failed;
+};
+
+
+
+/*********
+ * STATE *
+ *********/
+
+Uint16 replay_get_state(struct entities_t *entities, int i){
+    return entities->key_is_down[i] | entities->key_was_down[i] << 8;
+}
+
+void replay_set_state(struct entities_t *entities, int i, Uint16 state){
+    entities->key_is_down[i] = state;
+    entities->key_was_down[i] = state >> 8;
+}
+
+
+/*****************
+ * REPLAY WRITER *
+ *****************/
+
+int replay_write_varint(struct replay_writer_t *replay, Uint32 value){
+    struct pack_writer_t *writer = &replay->writer;
+    RET_IF_NZ(pack_writer_reserve(writer, 5));
+    while(value >= 0x80){
+        writer->data[writer->size++] = value | 0x80;
+        value >>= 7;
+    }
+    writer->data[writer->size++] = value;
+    return 0;
+}
+
+struct replay_writer_t *replay_writer_create(struct entities_t *entities, const char *scene_fname){
+    /* Starts recording the key states of entities which aren't CPU
+    controlled; see replay_writer_record */
+    struct replay_writer_t *replay = calloc(1, sizeof(*replay));
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating replay writer: %p, scene_fname=%s\n", replay, scene_fname);
+    }
+    if(replay == NULL)return NULL;
+    replay->scene_fname = scene_fname;
+    pack_writer_init(&replay->writer);
+
+    int n_entities = 0;
+    for(int i = 0; i < entities->n; i++){
+        if(!entities->controller[i].is_cpu)n_entities++;
+    }
+    replay->n_entities = n_entities;
+    replay->entities = malloc(sizeof(*replay->entities) * (n_entities + 1));
+    replay->states = calloc(n_entities + 1, sizeof(*replay->states));
+    if(replay->entities == NULL || replay->states == NULL)return NULL;
+    for(int i = 0, k = 0; i < entities->n; i++){
+        if(!entities->controller[i].is_cpu)replay->entities[k++] = entities_get_entity(entities, i);
+    }
+
+    /* Header gets filled in by replay_writer_save */
+    Uint8 header[REPLAY_HEADER_SIZE] = {0};
+    RET_NULL_IF_NZ(pack_write_bytes(&replay->writer, header, REPLAY_HEADER_SIZE));
+    RET_NULL_IF_NZ(pack_write_i32(&replay->writer, strlen(scene_fname)));
+    RET_NULL_IF_NZ(pack_write_bytes(&replay->writer, (const Uint8 *)scene_fname, strlen(scene_fname)));
+    for(int k = 0; k < n_entities; k++){
+        RET_NULL_IF_NZ(pack_write_i32(&replay->writer, replay->entities[k]));
+    }
+    return replay;
+}
+
+void replay_writer_destroy(struct replay_writer_t *replay){
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying replay writer: %p\n", replay);
+    }
+    free(replay->entities);
+    free(replay->states);
+    free(replay->writer.data);
+    free(replay);
+}
+
+int replay_writer_flush(struct replay_writer_t *replay){
+    /* Writes out the current run of unchanged ticks, if any */
+    if(replay->n_unchanged == 0)return 0;
+    RET_IF_NZ(replay_write_varint(replay, (Uint32)replay->n_unchanged << 1));
+    replay->n_unchanged = 0;
+    return 0;
+}
+
+int replay_writer_record(struct replay_writer_t *replay, struct entities_t *entities){
+    /* Records the key states world_do_tick is about to see: call it just
+    before each tick. Entities which have been removed are recorded as
+    having no keys down. */
+    int n_changed = 0;
+    for(int k = 0; k < replay->n_entities; k++){
+        int i = entities_get_i(entities, replay->entities[k]);
+        Uint16 state = i < 0? 0: replay_get_state(entities, i);
+        if(state != replay->states[k])n_changed++;
+    }
+    replay->n_ticks++;
+    if(n_changed == 0){
+        replay->n_unchanged++;
+        return 0;
+    }
+
+    RET_IF_NZ(replay_writer_flush(replay));
+    RET_IF_NZ(replay_write_varint(replay, (Uint32)n_changed << 1 | 1));
+    int last_k = -1;
+    for(int k = 0; k < replay->n_entities; k++){
+        int i = entities_get_i(entities, replay->entities[k]);
+        Uint16 state = i < 0? 0: replay_get_state(entities, i);
+        if(state == replay->states[k])continue;
+        RET_IF_NZ(replay_write_varint(replay, k - last_k - 1));
+        RET_IF_NZ(replay_write_varint(replay, state ^ replay->states[k]));
+        replay->states[k] = state;
+        last_k = k;
+    }
+    return 0;
+}
+
+int replay_writer_save(struct replay_writer_t *replay, const char *fname){
+    /* Writes everything recorded so far to fname; recording can carry on
+    afterwards */
+    RET_IF_NZ(replay_writer_flush(replay));
+
+    Uint8 *header = replay->writer.data;
+    memcpy(header, REPLAY_MAGIC, 4);
+    pack_encode_u32(header + 4, REPLAY_VERSION);
+    pack_encode_u32(header + 8, replay->n_ticks);
+    pack_encode_u32(header + 12, replay->n_entities);
+
+    FILE *f = fopen(fname, "wb");
+    if(f == NULL){
+        LOG("Could not open file for writing: %s\n", fname);
+        return 2;
+    }
+    size_t n_written_bytes = fwrite(replay->writer.data, 1, replay->writer.size, f);
+    if(fclose(f) != 0 || n_written_bytes != replay->writer.size){
+        LOG("Could not write file: %s\n", fname);
+        return 2;
+    }
+    if(DEBUG_LOAD >= 1){
+        LOG("Saved replay: fname=%s, n_ticks=%i, n_entities=%i, size=%u\n",
+            fname, replay->n_ticks, replay->n_entities, (unsigned int)replay->writer.size);
+    }
+    return 0;
+}
+
+
+/*****************
+ * REPLAY READER *
+ *****************/
+
+Uint32 replay_read_u32(struct replay_reader_t *replay){
+    if(replay->failed || replay->size - replay->pos < 4){
+        replay->failed = true;
+        return 0;
+    }
+    Uint32 value = pack_decode_u32(replay->data + replay->pos);
+    replay->pos += 4;
+    return value;
+}
+
+Uint32 replay_read_varint(struct replay_reader_t *replay){
+    Uint32 value = 0;
+    for(int shift = 0; shift < 35; shift += 7){
+        if(replay->failed || replay->pos == replay->size){
+            replay->failed = true;
+            return 0;
+        }
+        Uint8 byte = replay->data[replay->pos++];
+        value |= (Uint32)(byte & 0x7F) << shift;
+        if(!(byte & 0x80))return value;
+    }
+    replay->failed = true;
+    return 0;
+}
+
+void replay_reader_destroy(struct replay_reader_t *replay){
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying replay reader: %p\n", replay);
+    }
+    free((char *)replay->scene_fname);
+    free(replay->entities);
+    free(replay->states);
+    file_view_close(&replay->file);
+    free(replay);
+}
+
+struct replay_reader_t *replay_reader_load(const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading replay: fname=%s\n", fname);
+    }
+    struct replay_reader_t *replay = calloc(1, sizeof(*replay));
+    if(replay == NULL)return NULL;
+    replay->fname = fname;
+    RET_NULL_IF_NZ(file_view_open(fname, &replay->file));
+    replay->data = (const Uint8 *)replay->file.data;
+    replay->size = replay->file.size;
+
+    if(replay->size < REPLAY_HEADER_SIZE || memcmp(replay->data, REPLAY_MAGIC, 4) != 0){
+        LOG("Replay error: not a replay: %s\n", fname);
+        return NULL;
+    }
+    replay->pos = 4;
+    Uint32 version = replay_read_u32(replay);
+    if(version != REPLAY_VERSION){
+        LOG("Replay error: version %u, expected %i: %s\n", version, REPLAY_VERSION, fname);
+        return NULL;
+    }
+    Uint32 n_ticks = replay_read_u32(replay);
+    Uint32 n_entities = replay_read_u32(replay);
+    Uint32 scene_fname_len = replay_read_u32(replay);
+    if(replay->failed || scene_fname_len > replay->size - replay->pos){
+        LOG("Replay error: header out of range: %s\n", fname);
+        return NULL;
+    }
+    replay->scene_fname = strndup((const char *)replay->data + replay->pos, scene_fname_len);
+    if(replay->scene_fname == NULL)return NULL;
+    replay->pos += ((size_t)scene_fname_len + 3) & ~(size_t)3;
+    if(replay->pos > replay->size)replay->pos = replay->size;
+
+    if(n_ticks > 0x7fffffff || n_entities > (replay->size - replay->pos) / 4){
+        LOG("Replay error: header out of range: %s\n", fname);
+        return NULL;
+    }
+    replay->n_ticks = n_ticks;
+    replay->n_entities = n_entities;
+
+    replay->entities = malloc(sizeof(*replay->entities) * (n_entities + 1));
+    replay->states = calloc(n_entities + 1, sizeof(*replay->states));
+    if(replay->entities == NULL || replay->states == NULL)return NULL;
+    for(Uint32 k = 0; k < n_entities; k++)replay->entities[k] = replay_read_u32(replay);
+    if(replay->failed){
+        LOG("Replay error: truncated: %s\n", fname);
+        return NULL;
+    }
+
+    if(DEBUG_LOAD >= 1){
+        LOG("Loaded replay: %p, scene_fname=%s, n_ticks=%i, n_entities=%i\n",
+            replay, replay->scene_fname, replay->n_ticks, replay->n_entities);
+    }
+    return replay;
+}
+
+bool replay_reader_is_done(struct replay_reader_t *replay){
+    return replay->tick >= replay->n_ticks;
+}
+
+int replay_reader_play(struct replay_reader_t *replay, struct entities_t *entities){
+    /* Sets the recorded entities' key states for the next tick: call it
+    just before each tick, in place of real input */
+    if(replay_reader_is_done(replay)){
+        LOG("Replay error: no ticks left: %s\n", replay->fname);
+        return 2;
+    }
+    if(replay->n_unchanged == 0){
+        Uint32 value = replay_read_varint(replay);
+        if(value & 1){
+            Uint32 n_changed = value >> 1;
+            int k = -1;
+            for(Uint32 change = 0; change < n_changed && !replay->failed; change++){
+                Uint32 n_skipped = replay_read_varint(replay);
+                Uint32 delta = replay_read_varint(replay);
+                if(n_skipped >= (Uint32)(replay->n_entities - k - 1) || delta > 0xFFFF){
+                    replay->failed = true;
+                    break;
+                }
+                k += n_skipped + 1;
+                replay->states[k] ^= delta;
+            }
+        }else{
+            if(value >> 1 == 0)replay->failed = true;
+            replay->n_unchanged = value >> 1;
+        }
+        if(replay->failed){
+            LOG("Replay error: corrupt at byte %lu: %s\n", (unsigned long)replay->pos, replay->fname);
+            return 2;
+        }
+    }
+    if(replay->n_unchanged > 0)replay->n_unchanged--;
+    replay->tick++;
+
+    for(int k = 0; k < replay->n_entities; k++){
+        int i = entities_get_i(entities, replay->entities[k]);
+        if(i >= 0)replay_set_state(entities, i, replay->states[k]);
+    }
+    return 0;
+}
+
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "settings.h"
+#include "util.h"
+#include "parse.h"
+#include "map.h"
+#include "sprite.h"
+#include "world.h"
+#include "assets.h"
+
+
+/*
+    A scene is a map plus a bunch of sprites to put in its entrance room,
+    e.g. for benchmarks. The expected format is:
+
+        name=Lots of bats
+        map=data/map0.txt
+        len=2
+        sprites=
+            data/sprites/bat.txt 500 cpu
+            data/sprites/player.txt 1
+
+    Each line of "sprites" is a sprite filename, how many copies of it to
+    spawn, and optionally "cpu" to make them CPU-controlled.
+    Copies are scattered over the room in a repeatable way.
+*/
+
+
+int scene_spawn_sprites(struct world_t *world, struct assets_t *assets, const char *sprite_fname, int count, bool is_cpu, unsigned int *seed){
+    /* Loads sprite_fname once, then spawns count entities from it */
+    struct sprite_t *sprite = sprite_load(assets, sprite_fname);
+    if(sprite == NULL)return 2;
+
+    struct room_t *room = world->room;
+    struct tileset_t *tileset = sprite->tileset;
+    int max_x = room->w * room->tileset->tile_w * TILE_PIXEL_W - tileset->tile_w * TILE_PIXEL_W;
+    int max_y = room->h * room->tileset->tile_h * TILE_PIXEL_H - tileset->tile_h * TILE_PIXEL_H;
+
+    for(int i = 0; i < count; i++){
+        /* Numerical Recipes LCG: plenty random for scattering sprites */
+        *seed = *seed * 1664525u + 1013904223u;
+        int x = max_x <= 0? 0: (int)((*seed >> 8) % (unsigned int)max_x);
+        *seed = *seed * 1664525u + 1013904223u;
+        int y = max_y <= 0? 0: (int)((*seed >> 8) % (unsigned int)max_y);
+        RET_IF_NZ(world_spawn(world, sprite, x, y, is_cpu, NULL));
+    }
+    sprite_destroy(sprite, assets);
+    return 0;
+}
+
+struct scene_fields_t {
+    char *name;
+    char *map;
+    int len;
+};
+
+const struct field_t SCENE_FIELDS[] = {
+    {"name", FIELD_STRING, offsetof(struct scene_fields_t, name), false},
+    {"map", FIELD_STRING, offsetof(struct scene_fields_t, map), true},
+    {"len", FIELD_INT, offsetof(struct scene_fields_t, len), false},
+    {"sprites", FIELD_SECTION, 0, false}
+};
+
+struct schema_t SCENE_SCHEMA = SCHEMA("scene", SCENE_FIELDS);
+
+struct world_t *scene_load_world(struct assets_t *assets, const char *map_fname){
+    struct map_t *map = map_load(assets, map_fname);
+    if(map == NULL)return NULL;
+    return world_create(map);
+}
+
+struct world_t *scene_parse(struct assets_t *assets, struct parser_t *parser, const char *fname){
+    struct scene_fields_t fields = {NULL, NULL, 0};
+    unsigned int seen = 0;
+    struct world_t *world = NULL;
+    unsigned int seed = 0;
+
+    while(1){
+        const struct field_t *section;
+        RET_NULL_IF_NZ(parse_fields(parser, &SCENE_SCHEMA, &fields, &seen, &section));
+        if(section == NULL)break;
+
+        /* section is "sprites" */
+        if(fields.map == NULL){
+            LOG("Parse error: key \"map\" must come before \"sprites\"\n");
+            return NULL;
+        }
+        if(world == NULL){
+            world = scene_load_world(assets, fields.map);
+            if(world == NULL)return NULL;
+        }
+        for(int i = 0; i < fields.len; i++){
+            struct str_t line_str;
+            RET_NULL_IF_NZ(parse_string(parser, &line_str));
+            char *line = str_dup(line_str);
+            if(line == NULL)return NULL;
+
+            char sprite_fname[256];
+            int count = 0;
+            char cpu[4] = "";
+            if(sscanf(line, "%255s %i %3s", sprite_fname, &count, cpu) < 2){
+                LOG("Parse error: expected \"<sprite fname> <count> [cpu]\", got: %s\n", line);
+                return NULL;
+            }
+            free(line);
+            RET_NULL_IF_NZ(scene_spawn_sprites(world, assets, strndup(sprite_fname, sizeof(sprite_fname)),
+                count, strcmp(cpu, "cpu") == 0, &seed));
+        }
+    }
+
+    /* No sprites section: "map" is required, so it's been set */
+    if(world == NULL){
+        world = scene_load_world(assets, fields.map);
+        if(world == NULL)return NULL;
+    }
+
+    LOG("Loaded scene: name=%s\n", fields.name);
+    return world;
+}
+
+struct world_t *scene_load(struct assets_t *assets, const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading scene: fname=%s\n", fname);
+    }
+    struct file_view_t file;
+    RET_NULL_IF_NZ(file_view_open(fname, &file));
+    struct parser_t parser;
+    parser_init(&parser, file.data, file.size);
+    struct world_t *world = scene_parse(assets, &parser, fname);
+    file_view_close(&file);
+    return world;
+}
+
+
+#endif
@@ -14,10 +14,60 @@
 #define SCW (TILE_PIXEL_W * VIEW_W)
 #define SCH (TILE_PIXEL_H * VIEW_H)
 
-/* debug levels */
+/* length of a world tick in milliseconds, i.e. 1000 / ticks per second */
+#define TICK_MS 30
+
+/* max ticks run in one frame to catch up after a slow frame */
+#define MAX_CATCHUP_TICKS 5
+
+/* render modes, see world_render */
+#define RENDER_MODE_RECTS 0 /* tiles drawn pixel by pixel, batched by color */
+#define RENDER_MODE_TEXTURES 1 /* tiles drawn from tile caches, room from its layer */
+#define RENDER_MODE_FRAMEBUFFER 2 /* everything rasterized on the CPU, uploaded once */
+#define RENDER_MODE RENDER_MODE_TEXTURES
+
+/* max dirty rects tracked per frame before we just redraw everything */
+#define WORLD_MAX_DIRTY 64
+
+/* Asset pack baked by tools/bake.c; if it exists, assets are loaded from
+it rather than from their text files */
+#define PACK_FNAME "data/pack.bin"
+
+/* worker threads for loading assets, see assets_use_jobs: 0 for one per
+core, -1 to load everything on the main thread */
+#define LOAD_THREADS 0
+
+/* worker threads for ticking the world, see world_use_jobs: 0 for one
+per core, -1 to tick on the main thread only */
+#define TICK_THREADS 0
+
+/* entities per job when ticking, see world_do_tick */
+#define TICK_CHUNK_SIZE 4096
+
+/* memory (in bytes, roughly) a map keeps loaded rooms in; beyond that,
+the least recently used are evicted, see map_evict */
+#define MAP_ROOM_BUDGET (256 * 1024)
+
+/* size (in actual pixels) of the broad phase's cells, see broad.h */
+#define BROAD_CELL_SIZE 64
+
+/* If 1, collision tests use SSE2 where available (see collide.h) */
+#ifndef COLLIDE_SIMD
+#define COLLIDE_SIMD 1
+#endif
+
+/* If 1, mainloop times each phase of each frame; dump with F1, and
+on exit. If 0, the profiling code compiles to nothing. */
+#ifndef PROFILE_FRAMES
+#define PROFILE_FRAMES 1
+#endif
+
+/* debug levels, i.e. per-category log verbosity (see log.h) */
+#define DEBUG_CREATE 1 /* constructors & loaders announcing themselves */
 #define DEBUG_REPR 0
 #define DEBUG_PARSE 0
 #define DEBUG_LOAD 0
-#define DEBUG_RENDER 1
+#define DEBUG_RENDER 0
+#define DEBUG_TICK 0 /* dumps every controller, every tick */
 
 #endif
\ No newline at end of file
@@ -16,39 +16,29 @@ enum keys_e {
     KEYS
 };
 
-struct controller_t {
-    /* Sprite controlled by this controller */
-    struct sprite_t *sprite;
+/* Bit of each key in a Uint8 of key states, e.g. entities_t::key_is_down */
+#define KEY_BIT(key) (1 << (key))
 
-    /* Key info */
+struct controller_t {
+    /* Key info; the state of each key lives with the entity being
+    controlled (see entities_t) */
     SDL_Keycode keycodes[KEYS];
-    bool key_was_down[KEYS];
-    bool key_is_down[KEYS];
 
     /* Is this a CPU player? (AI-controlled) */
     bool is_cpu;
 };
 
 struct sprite_t {
+    /* A sprite as loaded from its file. The world is populated with
+    entities spawned from these (see world_spawn), which is where
+    positions, frames etc. live. */
+
     const char *name;
 
     /* filename from which this was loaded */
     const char *fname;
 
-    /* map coords of room we're in */
-    int room_x;
-    int room_y;
-
-    /* coords within room */
-    int x;
-    int y;
-
     struct tileset_t *tileset;
-
-    /* index of tile within tileset */
-    int frame;
-
-    struct controller_t controller;
 };
 
 
@@ -57,46 +47,31 @@ struct sprite_t {
  * CONTROLLER *
  **************/
 
-void controller_init(struct controller_t *controller, struct sprite_t *sprite, bool is_cpu){
-    LOG(); printf("Initializing controller: %p, sprite=%p, is_cpu=%i\n", controller, sprite, is_cpu);
-    controller->sprite = sprite;
+void controller_init(struct controller_t *controller, bool is_cpu){
     controller->is_cpu = is_cpu;
     for(int i = 0; i < KEYS; i++){
 
         /* The escape key is not valid as a controller key code.
         Only because there's no SDLK_NONE... or SDLK_UNSET... */
         controller->keycodes[i] = SDLK_ESCAPE;
-
-        controller->key_was_down[i] = false;
-        controller->key_is_down[i] = false;
     }
 }
 
 void controller_set_keycodes(struct controller_t *controller, SDL_Keycode keycodes[KEYS]){
+    /* Entities' controllers are set with entities_set_keycodes, which also
+    binds the keycodes so key events find them */
     for(int i = 0; i < KEYS; i++)controller->keycodes[i] = keycodes[i];
 }
 
 void controller_repr(struct controller_t *controller, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping controller: %p\n", controller);
+        LOG("Dumping controller: %p\n", controller);
     }
 
     REPR_FIELD_MULTI(keycodes, depth)
     for(int i = 0; i < KEYS; i++){
         print_tabs(depth + 1);
-        printf("%i\n", controller->keycodes[i]);
-    }
-
-    REPR_FIELD_MULTI(key_is_down, depth)
-    for(int i = 0; i < KEYS; i++){
-        print_tabs(depth + 1);
-        printf("%i\n", controller->key_is_down[i]);
-    }
-
-    REPR_FIELD_MULTI(key_was_down, depth)
-    for(int i = 0; i < KEYS; i++){
-        print_tabs(depth + 1);
-        printf("%i\n", controller->key_was_down[i]);
+        LOG_RAW("%i\n", controller->keycodes[i]);
     }
 
     REPR_FIELD(controller, is_cpu, "%i", depth)
@@ -107,88 +82,113 @@ void controller_repr(struct controller_t *controller, int depth){
  * SPRITE *
  **********/
 
-struct sprite_t *sprite_create(const char *name, const char *fname, struct tileset_t *tileset, int room_x, int room_y, int x, int y, bool is_cpu){
+struct sprite_t *sprite_create(const char *name, const char *fname, struct tileset_t *tileset){
     struct sprite_t *sprite = malloc(sizeof(*sprite));
-    LOG(); printf("Creating sprite: %p, name=%s, fname=%s, tileset=%p, room_x=%i, room_y=%i, x=%i, y=%i, is_cpu=%i\n",
-        sprite, name, fname, tileset, room_x, room_y, x, y, is_cpu);
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating sprite: %p, name=%s, fname=%s, tileset=%p\n", sprite, name, fname, tileset);
+    }
     if(sprite == NULL)return NULL;
     sprite->name = name;
     sprite->fname = fname;
     sprite->tileset = tileset;
-    sprite->room_x = room_x;
-    sprite->room_y = room_y;
-    sprite->x = x;
-    sprite->y = y;
-    sprite->frame = 0;
-    controller_init(&sprite->controller, sprite, is_cpu);
     return sprite;
 }
 
 void sprite_repr(struct sprite_t *sprite, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping sprite: %p\n", sprite);
+        LOG("Dumping sprite: %p\n", sprite);
     }
     REPR_FIELD(sprite, name, "%s", depth)
     REPR_FIELD_EXT(sprite, tileset, tileset->fname, "%s", depth)
-    REPR_FIELD(sprite, room_x, "%i", depth)
-    REPR_FIELD(sprite, room_y, "%i", depth)
-    REPR_FIELD(sprite, x, "%i", depth)
-    REPR_FIELD(sprite, y, "%i", depth)
-    REPR_FIELD(sprite, frame, "%i", depth)
 }
 
-struct sprite_t *sprite_load(const char *fname, int room_x, int room_y, int x, int y, bool is_cpu){
-    LOG(); printf("Loading sprite: fname=%s\n", fname);
-    char *fdata = load_file(fname);
-    if(fdata == NULL)return NULL;
+struct sprite_t *sprite_load_packed(struct assets_t *assets, struct pack_entry_t *entry, const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading packed sprite: fname=%s\n", fname);
+    }
+    struct pack_reader_t reader;
+    pack_reader_init(&reader, assets->pack, entry);
+    const char *name = pack_read_string(&reader);
+    const char *tileset_fname = pack_read_string(&reader);
+    RET_NULL_IF_NZ(pack_reader_check(&reader));
 
-    const char *name = "";
     struct tileset_t *tileset = NULL;
-    const char *tileset_fname = NULL;
-
-    char *key = NULL;
-    char *val = NULL;
-    int key_len = 0;
-    int val_len = 0;
-    while(1){
-        RET_NULL_IF_NZ(parse_item(&fdata, &key, &key_len, &val, &val_len));
-        if(key_len == 0)break;
-        if(strncmp(key, "name", key_len) == 0){
-            name = strndup(val, val_len);
-        }else if(strncmp(key, "tileset", key_len) == 0){
-            tileset_fname = strndup(val, val_len);
-            tileset = tileset_load(tileset_fname);
-            if(tileset == NULL)return NULL;
-        }else{
-            LOG(); printf("Parse error: unexpected key \"%.*s\"\n", key_len, key);
-            return NULL;
-        }
+    if(tileset_fname != NULL){
+        tileset = tileset_acquire(assets, tileset_fname);
+        if(tileset == NULL)return NULL;
     }
 
-    struct sprite_t *sprite = sprite_create(name, fname, tileset, room_x, room_y, x, y, is_cpu);
+    struct sprite_t *sprite = sprite_create(name, fname, tileset);
     if(sprite == NULL)return NULL;
 
     if(DEBUG_LOAD >= 1){
-        LOG(); printf("Loaded sprite: %p\n", sprite);
+        LOG("Loaded sprite: %p\n", sprite);
         sprite_repr(sprite, 1);
     }
 
     return sprite;
 }
 
-int sprite_render(struct sprite_t *sprite, int world_x, int world_y, struct pal_t *pal, SDL_Renderer *renderer){
-    if(DEBUG_RENDER >= 1){
-        LOG(); printf("Rendering sprite: %p\n", sprite);
+struct sprite_fields_t {
+    char *name;
+    char *tileset;
+};
+
+const struct field_t SPRITE_FIELDS[] = {
+    {"name", FIELD_STRING, offsetof(struct sprite_fields_t, name), false},
+    {"tileset", FIELD_STRING, offsetof(struct sprite_fields_t, tileset), false}
+};
+
+struct schema_t SPRITE_SCHEMA = SCHEMA("sprite", SPRITE_FIELDS);
+
+struct sprite_t *sprite_parse(struct assets_t *assets, struct parser_t *parser, const char *fname){
+    struct sprite_fields_t fields = {"", NULL};
+    unsigned int seen = 0;
+    const struct field_t *section;
+    RET_NULL_IF_NZ(parse_fields(parser, &SPRITE_SCHEMA, &fields, &seen, &section));
+
+    struct tileset_t *tileset = NULL;
+    if(fields.tileset != NULL){
+        tileset = tileset_acquire(assets, fields.tileset);
+        free(fields.tileset);
+        if(tileset == NULL)return NULL;
+    }
+
+    struct sprite_t *sprite = sprite_create(fields.name, fname, tileset);
+    if(sprite == NULL)return NULL;
+
+    if(DEBUG_LOAD >= 1){
+        LOG("Loaded sprite: %p\n", sprite);
+        sprite_repr(sprite, 1);
     }
 
-    struct tileset_t *tileset = sprite->tileset;
-    struct tile_t *tile = &tileset->tiles[sprite->frame];
-    RET_IF_NZ(tile_render(tile, tileset->tile_w, tileset->tile_h, world_x + sprite->x, world_y + sprite->y, pal, renderer));
+    return sprite;
+}
 
+struct sprite_t *sprite_load(struct assets_t *assets, const char *fname){
+    struct pack_entry_t *entry = assets_find_packed(assets, ASSET_SPRITE, fname);
+    if(entry != NULL)return sprite_load_packed(assets, entry, fname);
 
-    return 0;
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading sprite: fname=%s\n", fname);
+    }
+    struct file_view_t file;
+    RET_NULL_IF_NZ(file_view_open(fname, &file));
+    struct parser_t parser;
+    parser_init(&parser, file.data, file.size);
+    struct sprite_t *sprite = sprite_parse(assets, &parser, fname);
+    file_view_close(&file);
+    return sprite;
 }
 
+void sprite_destroy(struct sprite_t *sprite, struct assets_t *assets){
+    /* Frees sprite, releasing its tileset */
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying sprite: %p\n", sprite);
+    }
+    if(sprite->tileset != NULL)assets_release(assets, sprite->tileset);
+    free(sprite);
+}
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,26 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+
+/* Define RENDER_STATS as 1 (before including anything) to have render
+functions count what they do in render_stats, e.g. for benchmarks.
+Otherwise RENDER_STAT compiles to nothing. */
+#ifndef RENDER_STATS
+#define RENDER_STATS 0
+#endif
+
+
+struct render_stats_t {
+    /* draw calls issued to the renderer */
+    long long draw_calls;
+
+    /* actual pixels filled or copied, on the GPU or the CPU */
+    long long pixels;
+};
+
+struct render_stats_t render_stats = {0, 0};
+
+#define RENDER_STAT(calls, n_pixels) {if(RENDER_STATS){render_stats.draw_calls += (calls); render_stats.pixels += (n_pixels);}}
+
+
+#endif
@@ -9,14 +9,54 @@
 
 #include "settings.h"
 #include "util.h"
+#include "stats.h"
 #include "parse.h"
 #include "pal.h"
+#include "batch.h"
+#include "assets.h"
 
 
 
+/* widest tile allowed, so that a row of one can be decoded on the stack,
+and its mask fits in a word (see tile_t::mask_rows) */
+#define TILE_MAX_W 64
+
+/* tile pixels are 4-bit palette indices */
+#define TILE_MAX_COLORS 16
+
 struct tile_t {
-    /* tiles are owned by a tileset, which store the width & height */
-    int *data;
+    /* tiles are owned by a tileset, which store the width & height.
+    Pixels are row-major; pixel p is the low (even p) or high (odd p)
+    nibble of pixels[p / 2], and is transparent unless bit p % 8 of
+    mask[p / 8] is set. See tile_get_pixel & tile_get_row. */
+    Uint8 *pixels;
+    Uint8 *mask;
+
+    /* The mask again, a word per row for collision tests (see collide.h):
+    bit j of row i is set if pixel (j, i) is opaque. tile_h + 2 words, the
+    first & last of which are always 0, so rows -1 and tile_h can be read
+    too. Rebuilt from mask by tile_update_mask_rows. */
+    Uint64 *mask_rows;
+};
+
+struct tile_cache_t {
+    /* A tileset's tiles rasterized with a given palette into a single
+    texture atlas: tile i occupies the tile_w * tile_h texels starting at
+    x = i * tile_w. Transparent (-1) pixels get alpha 0.
+    Caches are owned by their tileset, one per (pal, renderer) pair. */
+
+    struct pal_t *pal;
+    SDL_Renderer *renderer;
+
+    /* versions of pal & tileset this was rasterized from */
+    int pal_version;
+    int tileset_version;
+
+    /* NULL if the texture couldn't be created, in which case we fall back
+    to tile_render */
+    SDL_Texture *texture;
+
+    struct tile_cache_t *next;
 };
 
 struct tileset_t {
@@ -30,6 +70,13 @@ struct tileset_t {
     int tile_w;
     int tile_h;
     struct tile_t *tiles;
+
+    /* bumped by tileset_touch whenever tile data changes */
+    int version;
+
+    /* linked list of rasterized copies of this tileset, see
+    tileset_get_cache */
+    struct tile_cache_t *caches;
 };
 
 
@@ -39,45 +86,113 @@ struct tileset_t {
  ********/
 
 int tile_init(struct tile_t *tile, int tile_w, int tile_h){
+    /* Allocates a fully transparent tile */
     int size = tile_w * tile_h;
-    LOG(); printf("Initializing tile: %p, tile_w=%i, tile_h=%i\n", tile, tile_w, tile_h);
-    tile->data = malloc(sizeof(*tile->data) * size);
-    if(tile->data == NULL)return 1;
-    for(int i = 0; i < size; i++)tile->data[i] = -1;
+    if(DEBUG_CREATE >= 1){
+        LOG("Initializing tile: %p, tile_w=%i, tile_h=%i\n", tile, tile_w, tile_h);
+    }
+    tile->pixels = calloc((size + 1) / 2, 1);
+    if(tile->pixels == NULL)return 1;
+    tile->mask = calloc((size + 7) / 8, 1);
+    if(tile->mask == NULL)return 1;
+    tile->mask_rows = calloc(tile_h + 2, sizeof(*tile->mask_rows));
+    if(tile->mask_rows == NULL)return 1;
+    return 0;
+}
+
+void tile_cleanup(struct tile_t *tile){
+    free(tile->pixels);
+    free(tile->mask);
+    free(tile->mask_rows);
+}
+
+void tile_update_mask_rows(struct tile_t *tile, int tile_w, int tile_h){
+    /* Call this after modifying the tile's pixels */
+    int p = 0;
+    for(int i = 0; i < tile_h; i++){
+        Uint64 row = 0;
+        for(int j = 0; j < tile_w; j++, p++){
+            row |= (Uint64)(tile->mask[p >> 3] >> (p & 7) & 1) << j;
+        }
+        tile->mask_rows[i + 1] = row;
+    }
+}
+
+const Uint64 *tile_get_mask_rows(struct tile_t *tile){
+    /* Returns row 0 of tile->mask_rows */
+    return tile->mask_rows + 1;
+}
+
+int tile_get_pixel(struct tile_t *tile, int p){
+    /* Returns pixel p's palette index (p being row * tile_w + col), or -1
+    if it's transparent */
+    if(!(tile->mask[p >> 3] >> (p & 7) & 1))return -1;
+    return tile->pixels[p >> 1] >> ((p & 1) * 4) & 0xF;
+}
+
+int tile_set_pixel(struct tile_t *tile, int p, int color_i){
+    /* Sets pixel p to a palette index, or -1 for transparent */
+    if(color_i < -1 || color_i >= TILE_MAX_COLORS){
+        LOG("Tile color out of range: %i, max=%i\n", color_i, TILE_MAX_COLORS - 1);
+        return 2;
+    }
+    Uint8 bit = 1 << (p & 7);
+    if(color_i < 0){
+        tile->mask[p >> 3] &= ~bit;
+        color_i = 0;
+    }else{
+        tile->mask[p >> 3] |= bit;
+    }
+    int shift = (p & 1) * 4;
+    tile->pixels[p >> 1] = (tile->pixels[p >> 1] & ~(0xF << shift)) | color_i << shift;
     return 0;
 }
 
+void tile_get_row(struct tile_t *tile, int tile_w, int i, int *row){
+    /* Decodes row i into tile_w palette indices (-1 for transparent), for
+    loops which look at every pixel */
+    int p = i * tile_w;
+    for(int j = 0; j < tile_w; j++, p++){
+        int color_i = tile->pixels[p >> 1] >> ((p & 1) * 4) & 0xF;
+        row[j] = tile->mask[p >> 3] >> (p & 7) & 1? color_i: -1;
+    }
+}
+
 void tile_repr(struct tile_t *tile, int tile_w, int tile_h, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping tile: %p\n", tile);
+        LOG("Dumping tile: %p\n", tile);
     }
+    int data[TILE_MAX_W];
     REPR_FIELD_MULTI(data, depth)
-    repr_intmap(tile->data, tile_w, tile_h, "%s", "%X", depth+1);
-}
-
-int tile_parse(struct tile_t *tile, char **fdata, int tile_w, int tile_h){
-    char *key = NULL;
-    char *val = NULL;
-    int key_len = 0;
-    int val_len = 0;
-    while(1){
-        RET_IF_NZ(parse_item(fdata, &key, &key_len, &val, &val_len));
-        if(key_len == 0){
-            LOG(); printf("Parse error: expected key \"data\"\n");
-            return 2;
-        }
-        if(strncmp(key, "data", key_len) == 0){
-            break;
-        }else{
-            LOG(); printf("Parse error: unexpected key \"%.*s\"\n", key_len, key);
-            return 2;
-        }
+    for(int i = 0; i < tile_h; i++){
+        tile_get_row(tile, tile_w, i, data);
+        repr_intmap(data, tile_w, 1, "%s", "%X", depth+1);
     }
+}
+
+const struct field_t TILE_FIELDS[] = {
+    {"data", FIELD_SECTION, 0, true}
+};
 
-    RET_IF_NZ(parse_intmap(fdata, tile->data, tile_w, tile_h, 16));
+struct schema_t TILE_SCHEMA = SCHEMA("tile", TILE_FIELDS);
+
+int tile_parse(struct tile_t *tile, struct parser_t *parser, int tile_w, int tile_h){
+    /* Tiles have no fields, just their data */
+    unsigned int seen = 0;
+    const struct field_t *section;
+    RET_IF_NZ(parse_fields(parser, &TILE_SCHEMA, NULL, &seen, &section));
+
+    int size = tile_w * tile_h;
+    int *data = size == 0? NULL: malloc(sizeof(*data) * size);
+    if(size != 0 && data == NULL)return 1;
+    int e = parse_intmap(parser, data, tile_w, tile_h, 16);
+    for(int p = 0; !e && p < size; p++)e = tile_set_pixel(tile, p, data[p]);
+    free(data);
+    if(e)return e;
+    tile_update_mask_rows(tile, tile_w, tile_h);
 
     if(DEBUG_LOAD >= 1){
-        LOG(); printf("Parsed tile: %p\n", tile);
+        LOG("Parsed tile: %p\n", tile);
         tile_repr(tile, tile_w, tile_h, 1);
     }
 
@@ -89,16 +204,19 @@ int tile_render(struct tile_t *tile, int tile_w, int tile_h, int tile_x, int til
     rect.w = TILE_PIXEL_W;
     rect.h = TILE_PIXEL_H;
 
+    int row[TILE_MAX_W];
     rect.y = tile_y;
     for(int i = 0; i < tile_h; i++){
+        tile_get_row(tile, tile_w, i, row);
         rect.x = tile_x;
         for(int j = 0; j < tile_w; j++){
 
-            int color_i = tile->data[i * tile_w + j];
+            int color_i = row[j];
             if(color_i >= 0){
                 SDL_Color *c = &pal->colors[color_i];
                 RET_IF_SDL_ERR(SDL_SetRenderDrawColor(renderer, c->r, c->g, c->b, SDL_ALPHA_OPAQUE));
                 RET_IF_SDL_ERR(SDL_RenderFillRect(renderer, &rect));
+                RENDER_STAT(1, rect.w * rect.h)
             }
 
             rect.x += rect.w;
@@ -108,6 +226,33 @@ int tile_render(struct tile_t *tile, int tile_w, int tile_h, int tile_x, int til
     return 0;
 }
 
+int tile_render_batch(struct tile_t *tile, int tile_w, int tile_h, int tile_x, int tile_y, struct pal_t *pal, struct draw_batch_t *batch, SDL_Renderer *renderer){
+    /* Like tile_render, but adds rects to batch instead of drawing them,
+    merging horizontal runs of same-colored pixels into one rect */
+    SDL_Rect rect;
+    rect.h = TILE_PIXEL_H;
+
+    int row[TILE_MAX_W];
+    rect.y = tile_y;
+    for(int i = 0; i < tile_h; i++){
+        tile_get_row(tile, tile_w, i, row);
+        int j = 0;
+        while(j < tile_w){
+            int color_i = row[j];
+            int run = 1;
+            while(j + run < tile_w && row[j + run] == color_i)run++;
+            if(color_i >= 0){
+                rect.x = tile_x + j * TILE_PIXEL_W;
+                rect.w = run * TILE_PIXEL_W;
+                RET_IF_NZ(draw_batch_add_rect(batch, &rect, pal, color_i, renderer));
+            }
+            j += run;
+        }
+        rect.y += rect.h;
+    }
+    return 0;
+}
+
 
 /***********
  * TILESET *
@@ -115,13 +260,21 @@ int tile_render(struct tile_t *tile, int tile_w, int tile_h, int tile_x, int til
 
 struct tileset_t *tileset_create(const char *name, const char *fname, int tile_w, int tile_h, int len){
     struct tileset_t *tileset = malloc(sizeof(*tileset));
-    LOG(); printf("Creating tileset: %p, name=%s, fname=%s, tile_w=%i, tile_h=%i, len=%i\n", tileset, name, fname, tile_w, tile_h, len);
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating tileset: %p, name=%s, fname=%s, tile_w=%i, tile_h=%i, len=%i\n", tileset, name, fname, tile_w, tile_h, len);
+    }
     if(tileset == NULL)return NULL;
+    if(tile_w > TILE_MAX_W){
+        LOG("Tiles too wide: tile_w=%i, max=%i\n", tile_w, TILE_MAX_W);
+        return NULL;
+    }
     tileset->name = name;
     tileset->fname = fname;
     tileset->tile_w = tile_w;
     tileset->tile_h = tile_h;
     tileset->len = len;
+    tileset->version = 0;
+    tileset->caches = NULL;
     tileset->tiles = len == 0? NULL: malloc(sizeof(*tileset->tiles) * len);
     if(len != 0 && tileset->tiles == NULL)return NULL;
     for(int i = 0; i < len; i++){
@@ -130,9 +283,17 @@ struct tileset_t *tileset_create(const char *name, const char *fname, int tile_w
     return tileset;
 }
 
+void tileset_touch(struct tileset_t *tileset){
+    /* Call this after modifying the data of any of tileset's tiles */
+    tileset->version++;
+    for(int i = 0; i < tileset->len; i++){
+        tile_update_mask_rows(&tileset->tiles[i], tileset->tile_w, tileset->tile_h);
+    }
+}
+
 void tileset_repr(struct tileset_t *tileset, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping tileset: %p\n", tileset);
+        LOG("Dumping tileset: %p\n", tileset);
     }
     REPR_FIELD(tileset, name, "%s", depth)
     REPR_FIELD(tileset, tile_w, "%i", depth)
@@ -144,51 +305,87 @@ void tileset_repr(struct tileset_t *tileset, int depth){
     }
 }
 
+struct tileset_fields_t {
+    char *name;
+    int tile_w;
+    int tile_h;
+    int len;
+};
+
+const struct field_t TILESET_FIELDS[] = {
+    {"name", FIELD_STRING, offsetof(struct tileset_fields_t, name), false},
+    {"tile_w", FIELD_INT, offsetof(struct tileset_fields_t, tile_w), false},
+    {"tile_h", FIELD_INT, offsetof(struct tileset_fields_t, tile_h), false},
+    {"len", FIELD_INT, offsetof(struct tileset_fields_t, len), false},
+    {"tiles", FIELD_SECTION, 0, true}
+};
+
+struct schema_t TILESET_SCHEMA = SCHEMA("tileset", TILESET_FIELDS);
+
+struct tileset_t *tileset_parse(struct parser_t *parser, const char *fname){
+    struct tileset_fields_t fields = {"", 0, 0, 0};
+    unsigned int seen = 0;
+    const struct field_t *section;
+    RET_NULL_IF_NZ(parse_fields(parser, &TILESET_SCHEMA, &fields, &seen, &section));
+    int tile_w = fields.tile_w;
+    int tile_h = fields.tile_h;
+    int len = fields.len;
+
+    struct tileset_t *tileset = tileset_create(fields.name, fname, tile_w, tile_h, len);
+    if(tileset == NULL)return NULL;
+
+    for(int i = 0; i < len; i++){
+        RET_NULL_IF_NZ(tile_parse(&tileset->tiles[i], parser, tile_w, tile_h));
+    }
+
+    if(DEBUG_LOAD >= 1){
+        LOG("Loaded tileset: %p\n", tileset);
+        tileset_repr(tileset, 1);
+    }
+
+    return tileset;
+}
+
 struct tileset_t *tileset_load(const char *fname){
-    LOG(); printf("Loading tileset: fname=%s\n", fname);
-    char *fdata = load_file(fname);
-    if(fdata == NULL)return NULL;
-
-    const char *name = "";
-    int tile_w = 0;
-    int tile_h = 0;
-    int len = 0;
-
-    char *key = NULL;
-    char *val = NULL;
-    int key_len = 0;
-    int val_len = 0;
-    while(1){
-        RET_NULL_IF_NZ(parse_item(&fdata, &key, &key_len, &val, &val_len));
-        if(key_len == 0){
-            LOG(); printf("Parse error: expected key \"tiles\"\n");
-            return NULL;
-        }
-        if(strncmp(key, "name", key_len) == 0){
-            name = strndup(val, val_len);
-        }else if(strncmp(key, "tile_w", key_len) == 0){
-            tile_w = atoi(val);
-        }else if(strncmp(key, "tile_h", key_len) == 0){
-            tile_h = atoi(val);
-        }else if(strncmp(key, "len", key_len) == 0){
-            len = atoi(val);
-        }else if(strncmp(key, "tiles", key_len) == 0){
-            break;
-        }else{
-            LOG(); printf("Parse error: unexpected key \"%.*s\"\n", key_len, key);
-            return NULL;
-        }
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading tileset: fname=%s\n", fname);
+    }
+    struct file_view_t file;
+    RET_NULL_IF_NZ(file_view_open(fname, &file));
+    struct parser_t parser;
+    parser_init(&parser, file.data, file.size);
+    struct tileset_t *tileset = tileset_parse(&parser, fname);
+    file_view_close(&file);
+    return tileset;
+}
+
+struct tileset_t *tileset_load_packed(struct pack_t *pack, struct pack_entry_t *entry, const char *fname){
+    if(DEBUG_CREATE >= 1){
+        LOG("Loading packed tileset: fname=%s\n", fname);
     }
+    struct pack_reader_t reader;
+    pack_reader_init(&reader, pack, entry);
+    const char *name = pack_read_string(&reader);
+    int tile_w = pack_read_len(&reader);
+    int tile_h = pack_read_len(&reader);
+    int len = pack_read_len(&reader);
+    Uint64 tile_size = (Uint64)tile_w * tile_h;
+    pack_reader_has(&reader, ((tile_size + 1) / 2 + (tile_size + 7) / 8) * len);
+    RET_NULL_IF_NZ(pack_reader_check(&reader));
+    int size = tile_size;
 
     struct tileset_t *tileset = tileset_create(name, fname, tile_w, tile_h, len);
     if(tileset == NULL)return NULL;
 
     for(int i = 0; i < len; i++){
-        RET_NULL_IF_NZ(tile_parse(&tileset->tiles[i], &fdata, tile_w, tile_h));
+        pack_read_bytes(&reader, tileset->tiles[i].pixels, (size + 1) / 2);
+        pack_read_bytes(&reader, tileset->tiles[i].mask, (size + 7) / 8);
+        tile_update_mask_rows(&tileset->tiles[i], tile_w, tile_h);
     }
+    RET_NULL_IF_NZ(pack_reader_check(&reader));
 
     if(DEBUG_LOAD >= 1){
-        LOG(); printf("Loaded tileset: %p\n", tileset);
+        LOG("Loaded tileset: %p\n", tileset);
         tileset_repr(tileset, 1);
     }
 
@@ -196,4 +393,164 @@ struct tileset_t *tileset_load(const char *fname){
 }
 
 
+/**************
+ * TILE CACHE *
+ **************/
+
+int tile_cache_rasterize(struct tile_cache_t *cache, struct tileset_t *tileset){
+    int tile_w = tileset->tile_w;
+    int tile_h = tileset->tile_h;
+    int atlas_w = tile_w * tileset->len;
+    struct pal_t *pal = cache->pal;
+
+    Uint32 *pixels = malloc(sizeof(*pixels) * atlas_w * tile_h);
+    if(pixels == NULL)return 1;
+
+    for(int t = 0; t < tileset->len; t++){
+        struct tile_t *tile = &tileset->tiles[t];
+        for(int i = 0; i < tile_h; i++){
+            for(int j = 0; j < tile_w; j++){
+                Uint32 pixel = 0;
+                int color_i = tile_get_pixel(tile, i * tile_w + j);
+                if(color_i >= 0 && color_i < pal->len){
+                    pixel = pal->argb[color_i];
+                }
+                pixels[i * atlas_w + t * tile_w + j] = pixel;
+            }
+        }
+    }
+
+    int e = SDL_UpdateTexture(cache->texture, NULL, pixels, sizeof(*pixels) * atlas_w);
+    free(pixels);
+    RET_IF_SDL_ERR(e);
+
+    cache->pal_version = cache->pal->version;
+    cache->tileset_version = tileset->version;
+    return 0;
+}
+
+struct tile_cache_t *tile_cache_create(struct tileset_t *tileset, struct pal_t *pal, SDL_Renderer *renderer){
+    struct tile_cache_t *cache = malloc(sizeof(*cache));
+    if(DEBUG_RENDER >= 1){
+        LOG("Creating tile cache: %p, tileset=%s, pal=%s\n", cache, tileset->fname, pal->fname);
+    }
+    if(cache == NULL)return NULL;
+    cache->pal = pal;
+    cache->renderer = renderer;
+    cache->next = NULL;
+
+    cache->texture = tileset->len == 0? NULL: SDL_CreateTexture(renderer,
+        SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+        tileset->tile_w * tileset->len, tileset->tile_h);
+    if(cache->texture == NULL){
+        LOG("Couldn't create tile cache texture, falling back to rects: %s\n", SDL_GetError());
+    }else if(
+        SDL_SetTextureBlendMode(cache->texture, SDL_BLENDMODE_BLEND) < 0 ||
+        tile_cache_rasterize(cache, tileset)
+    ){
+        LOG("Couldn't rasterize tile cache, falling back to rects\n");
+        SDL_DestroyTexture(cache->texture);
+        cache->texture = NULL;
+    }
+    return cache;
+}
+
+void tileset_cache_clear(struct tileset_t *tileset){
+    /* Frees all of tileset's caches, e.g. before destroying the renderer
+    they were created with */
+    struct tile_cache_t *cache = tileset->caches;
+    while(cache != NULL){
+        struct tile_cache_t *next = cache->next;
+        if(cache->texture != NULL)SDL_DestroyTexture(cache->texture);
+        free(cache);
+        cache = next;
+    }
+    tileset->caches = NULL;
+}
+
+struct tile_cache_t *tileset_get_cache(struct tileset_t *tileset, struct pal_t *pal, SDL_Renderer *renderer){
+    /* Returns tileset's cache for the given pal & renderer, creating it
+    or re-rasterizing it if pal or tileset changed since it was built */
+    struct tile_cache_t *cache;
+    for(cache = tileset->caches; cache != NULL; cache = cache->next){
+        if(cache->pal == pal && cache->renderer == renderer)break;
+    }
+
+    if(cache == NULL){
+        cache = tile_cache_create(tileset, pal, renderer);
+        if(cache == NULL)return NULL;
+        cache->next = tileset->caches;
+        tileset->caches = cache;
+    }else if(cache->texture != NULL && (
+        cache->pal_version != pal->version ||
+        cache->tileset_version != tileset->version
+    )){
+        if(tile_cache_rasterize(cache, tileset)){
+            LOG("Couldn't re-rasterize tile cache, falling back to rects\n");
+            SDL_DestroyTexture(cache->texture);
+            cache->texture = NULL;
+        }
+    }
+    return cache;
+}
+
+int tileset_render_tile(struct tileset_t *tileset, int tile_i, int tile_x, int tile_y, struct pal_t *pal, SDL_Renderer *renderer, struct draw_batch_t *batch){
+    /* Renders one tile as a single textured quad from the tile cache,
+    or pixel by pixel if there is no cache texture (or batch->force_rects).
+    The pixel by pixel path goes through batch if it's not NULL, otherwise
+    through tile_render. */
+    int tile_w = tileset->tile_w;
+    int tile_h = tileset->tile_h;
+    struct tile_t *tile = &tileset->tiles[tile_i];
+
+    struct tile_cache_t *cache = NULL;
+    if(batch == NULL || !batch->force_rects){
+        cache = tileset_get_cache(tileset, pal, renderer);
+        if(cache == NULL)return 1;
+    }
+    if(cache == NULL || cache->texture == NULL){
+        if(batch != NULL){
+            return tile_render_batch(tile, tile_w, tile_h, tile_x, tile_y, pal, batch, renderer);
+        }
+        return tile_render(tile, tile_w, tile_h, tile_x, tile_y, pal, renderer);
+    }
+
+    /* Anything already batched must be drawn before (i.e. under) us */
+    if(batch != NULL)RET_IF_NZ(draw_batch_flush(batch, renderer));
+
+    SDL_Rect src = {tile_i * tile_w, 0, tile_w, tile_h};
+    SDL_Rect dst = {tile_x, tile_y, tile_w * TILE_PIXEL_W, tile_h * TILE_PIXEL_H};
+    RET_IF_SDL_ERR(SDL_RenderCopy(renderer, cache->texture, &src, &dst));
+    RENDER_STAT(1, dst.w * dst.h)
+    return 0;
+}
+
+
+void tileset_destroy(struct tileset_t *tileset){
+    if(DEBUG_CREATE >= 1){
+        LOG("Destroying tileset: %p\n", tileset);
+    }
+    tileset_cache_clear(tileset);
+    for(int i = 0; i < tileset->len; i++)tile_cleanup(&tileset->tiles[i]);
+    free(tileset->tiles);
+    free(tileset);
+}
+
+void *tileset_asset_load(struct assets_t *assets, const char *fname){
+    struct pack_entry_t *entry = assets_find_packed(assets, ASSET_TILESET, fname);
+    if(entry != NULL)return tileset_load_packed(assets->pack, entry, fname);
+    return tileset_load(fname);
+}
+
+void tileset_asset_destroy(struct assets_t *assets, void *data){
+    tileset_destroy(data);
+}
+
+struct tileset_t *tileset_acquire(struct assets_t *assets, const char *fname){
+    /* Loads fname through assets, see assets_acquire.
+    Give the tileset back with assets_release. */
+    return assets_acquire(assets, ASSET_TILESET, fname, tileset_asset_load, tileset_asset_destroy);
+}
+
+
 #endif
\ No newline at end of file
@@ -1,10 +1,23 @@
 
+/* For mmap & friends */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include "util.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define USE_MMAP 0
+#endif
+
 
 int INT_MIN(int a, int b){
     return a <= b? a: b;
@@ -53,40 +66,86 @@ char *strndup(const char *s1, size_t len){
     size_t s_len = strnlen(s1, len);
     char *s2 = malloc(s_len + 1);
     if(s2 == NULL)return NULL;
-    strncpy(s2, s1, len);
+    memcpy(s2, s1, s_len);
     s2[s_len] = '\0';
     return s2;
 }
 
-char *load_file(const char *filename){
-    FILE *f = fopen(filename, "r");
-    long f_size;
-    char *f_buffer;
-    size_t n_read_bytes;
+int file_view_open(const char *filename, struct file_view_t *file){
+    /* Maps filename into memory, read-only. Where mmap isn't available,
+    reads it into a buffer instead. Either way, the data is NOT
+    NUL-terminated: use data + size as the end. */
+    file->data = NULL;
+    file->size = 0;
+    file->is_mapped = false;
+
+#if USE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        ERR_INFO(); fprintf(stderr, "Could not open file: %s\n", filename);
+        return 2;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0){
+        ERR_INFO(); fprintf(stderr, "Could not stat file: %s\n", filename);
+        close(fd);
+        return 2;
+    }
+    if(st.st_size > 0){
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED){
+            ERR_INFO(); fprintf(stderr, "Could not map file: %s\n", filename);
+            close(fd);
+            return 2;
+        }
+        file->data = data;
+        file->size = st.st_size;
+        file->is_mapped = true;
+    }
+
+    /* The mapping stays valid without the fd */
+    close(fd);
+    return 0;
+#else
+    FILE *f = fopen(filename, "rb");
     if(f == NULL){
         ERR_INFO(); fprintf(stderr, "Could not open file: %s\n", filename);
-        return NULL;
+        return 2;
     }
 
     fseek(f, 0, SEEK_END);
-    f_size = ftell(f);
+    long f_size = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    f_buffer = malloc(f_size + 1);
+    char *f_buffer = malloc(f_size > 0? f_size: 1);
     if(f_buffer == NULL){
         ERR_INFO(); fprintf(stderr, "Could not allocate buffer for file: %s (%li bytes)\n", filename, f_size);
         fclose(f);
-        return NULL;
+        return 1;
     }
-    n_read_bytes = fread(f_buffer, 1, f_size, f);
+    file->data = f_buffer;
+    file->size = fread(f_buffer, 1, f_size, f);
     fclose(f);
+    return 0;
+#endif
+}
 
-    return f_buffer;
+void file_view_close(struct file_view_t *file){
+    /* Releases the file's data; anything still pointing into it is
+    invalid from here on */
+#if USE_MMAP
+    if(file->is_mapped)munmap((void *)file->data, file->size);
+#else
+    free((void *)file->data);
+#endif
+    file->data = NULL;
+    file->size = 0;
+    file->is_mapped = false;
 }
 
 void print_tabs(int depth){
     for(int i = 0; i < depth; i++){
-        printf("  ");
+        LOG_RAW("  ");
     }
 }
 
@@ -3,10 +3,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "map.h"
 #include "parse.h"
 #include "sprite.h"
+#include "entities.h"
+#include "collide.h"
+#include "broad.h"
+#include "jobs.h"
+#include "flow.h"
 
 
 struct world_t {
@@ -18,65 +25,253 @@ struct world_t {
     int room_y;
     struct room_t *room;
 
-    int n_sprites;
-    struct sprite_t **sprites;
+    struct entities_t *entities;
+
+    /* the current room's entities, see world_get_broad; broad_is_stale is
+    set by anything which moves, adds or removes entities */
+    struct broad_t *broad;
+    bool broad_is_stale;
+
+    /* What CPU-controlled entities chase: entities spawned as non-CPU
+    (handles of removed ones are dropped as they're noticed); and the
+    current room's flow field towards those in it, see world_update_flow.
+    target_tiles has room for targets_cap too. */
+    int n_targets;
+    int targets_cap;
+    entity_t *targets;
+    int *target_tiles;
+    struct flow_field_t flow;
+
+    /* NULL unless world_use_jobs was called, in which case ticks are
+    spread over its workers, see world_do_tick */
+    struct job_pool_t *jobs;
+
+    /* Per entity, during a tick: the keys it acts on, & where it's
+    headed; room for tick_cap entities */
+    int tick_cap;
+    Uint8 *tick_keys;
+    int *next_x;
+    int *next_y;
+
+    /* How far we are between the last tick and the next one, from 0 to 1.
+    Set by the main loop before rendering, for anything that wants to
+    interpolate between ticks. */
+    float tick_alpha;
+
+    /* one of the RENDER_MODE_* values */
+    int render_mode;
+
+    /* frame-level buffer for anything drawn as rects */
+    struct draw_batch_t *batch;
+
+    /* SCW x SCH buffer for RENDER_MODE_FRAMEBUFFER, created on first use */
+    struct framebuffer_t *framebuffer;
+
+    /* The room rasterized into a buffer the same size as framebuffer, which
+    dirty regions are restored from; and what it was rasterized from */
+    struct framebuffer_t *background;
+    struct room_t *background_room;
+    struct tileset_t *background_tileset;
+    struct pal_t *background_pal;
+    int background_version;
+
+    /* Regions (in room coords) which changed since the last render, see
+    world_mark_dirty. Only RENDER_MODE_FRAMEBUFFER makes use of these,
+    since its framebuffer is the only render output which persists
+    from one frame to the next. */
+    bool dirty_all;
+    int n_dirty;
+    SDL_Rect dirty[WORLD_MAX_DIRTY];
 };
 
 struct world_t *world_create(struct map_t *map){
     struct world_t *world = malloc(sizeof(*world));
-    LOG(); printf("Creating world: %p, map=%p\n", world, map);
+    if(DEBUG_CREATE >= 1){
+        LOG("Creating world: %p, map=%p\n", world, map);
+    }
     if(world == NULL)return NULL;
 
     world->map = map;
     world->room_x = map->entrance_x;
     world->room_y = map->entrance_y;
 
+    /* We hold our own reference to the room we're in, so the map can
+    evict it whenever it likes */
     world->room = map_get_room(map, world->room_x, world->room_y, false);
     if(world->room == NULL){
-        LOG(); printf("Couldn't get initial room: room_x=%i, room_y=%i\n", world->room_x, world->room_y);
+        LOG("Couldn't get initial room: room_x=%i, room_y=%i\n", world->room_x, world->room_y);
         return NULL;
     }
+    RET_NULL_IF_NZ(assets_retain(map->assets, world->room));
+    RET_NULL_IF_NZ(map_prefetch(map, world->room_x, world->room_y));
+
+    world->entities = entities_create(map->w, map->h);
+    if(world->entities == NULL)return NULL;
+    world->broad = broad_create();
+    if(world->broad == NULL)return NULL;
+    world->broad_is_stale = true;
+    world->n_targets = 0;
+    world->targets_cap = 0;
+    world->targets = NULL;
+    world->target_tiles = NULL;
+    flow_field_init(&world->flow);
+
+    world->jobs = NULL;
+    world->tick_cap = 0;
+    world->tick_keys = NULL;
+    world->next_x = NULL;
+    world->next_y = NULL;
+    world->tick_alpha = 0;
 
-    world->n_sprites = 0;
-    world->sprites = NULL;
+    world->render_mode = RENDER_MODE;
+    world->batch = draw_batch_create(RENDER_MODE == RENDER_MODE_RECTS);
+    if(world->batch == NULL)return NULL;
+    world->framebuffer = NULL;
+    world->background = NULL;
+    world->background_room = NULL;
+    world->dirty_all = true;
+    world->n_dirty = 0;
 
     return world;
 }
 
-int world_sprites_resize(struct world_t *world, int new_n_sprites){
-    int diff = new_n_sprites - world->n_sprites;
-    for(int i = new_n_sprites; i < world->n_sprites; i++){
-        if(world->sprites[i] != NULL){
-            LOG(); printf("Tried to shrink sprite array past a non-NULL sprite: old_n_sprites=%i, new_n_sprites=%i\n",
-                world->n_sprites, new_n_sprites);
-            return 2;
-        }
+void world_mark_dirty(struct world_t *world, SDL_Rect *rect){
+    /* Marks a region as needing to be redrawn */
+    if(world->dirty_all)return;
+    if(world->n_dirty >= WORLD_MAX_DIRTY){
+        world->dirty_all = true;
+        return;
+    }
+    world->dirty[world->n_dirty++] = *rect;
+}
+
+void world_mark_dirty_moved(struct world_t *world, SDL_Rect *old_rect, SDL_Rect *new_rect){
+    /* Marks the old & new areas of something which moved or changed.
+    Small moves (the usual case) get a single rect covering both. */
+    if(SDL_HasIntersection(old_rect, new_rect)){
+        SDL_Rect rect;
+        SDL_UnionRect(old_rect, new_rect, &rect);
+        world_mark_dirty(world, &rect);
+    }else{
+        world_mark_dirty(world, old_rect);
+        world_mark_dirty(world, new_rect);
+    }
+}
+
+int world_set_room(struct world_t *world, int room_x, int room_y){
+    struct room_t *room = map_get_room(world->map, room_x, room_y, false);
+    if(room == NULL){
+        LOG("Couldn't get room: room_x=%i, room_y=%i\n", room_x, room_y);
+        return 2;
     }
-    struct sprite_t **new_sprites = realloc(world->sprites, sizeof(*world->sprites) * new_n_sprites);
-    if(new_sprites == NULL)return 1;
-    for(int i = world->n_sprites; i < new_n_sprites; i++)new_sprites[i] = NULL;
-    world->n_sprites = new_n_sprites;
-    world->sprites = new_sprites;
+    if(room != world->room){
+        /* Only the current room keeps a pre-rendered layer around; the new
+        room's layer gets built the first time it's rendered */
+        room_layer_clear(world->room);
+        RET_IF_NZ(assets_retain(world->map->assets, room));
+        RET_IF_NZ(assets_release(world->map->assets, world->room));
+    }
+    world->room_x = room_x;
+    world->room_y = room_y;
+    world->room = room;
+    world->dirty_all = true;
+    world->broad_is_stale = true;
+    return map_prefetch(world->map, room_x, room_y);
+}
+
+int world_add_target(struct world_t *world, entity_t entity){
+    /* Makes CPU-controlled entities chase entity (whenever it's in the
+    current room) */
+    if(world->n_targets == world->targets_cap){
+        int cap = world->targets_cap == 0? 4: world->targets_cap * 2;
+        entity_t *targets = realloc(world->targets, sizeof(*targets) * cap);
+        if(targets == NULL)return 1;
+        world->targets = targets;
+        int *target_tiles = realloc(world->target_tiles, sizeof(*target_tiles) * cap);
+        if(target_tiles == NULL)return 1;
+        world->target_tiles = target_tiles;
+        world->targets_cap = cap;
+    }
+    world->targets[world->n_targets++] = entity;
     return 0;
 }
 
-int world_sprites_add(struct world_t *world, struct sprite_t *sprite){
-    int sprite_i;
-    for(sprite_i = 0; sprite_i < world->n_sprites; sprite_i++){
-        if(world->sprites[sprite_i] == NULL)break;
+int world_spawn(struct world_t *world, struct sprite_t *sprite, int x, int y, bool is_cpu, entity_t *entity){
+    /* Adds an entity spawned from sprite to the current room, see
+    entities_add. Non-CPU entities become targets, see world_add_target. */
+    struct entities_t *entities = world->entities;
+    RET_IF_NZ(entities_add(entities, world->map->assets, sprite, world->room_x, world->room_y, x, y, is_cpu, entity));
+    int i = entities->n - 1;
+    if(!is_cpu)RET_IF_NZ(world_add_target(world, entities_get_entity(entities, i)));
+
+    SDL_Rect rect;
+    entity_get_rect(entities, i, &rect);
+    world_mark_dirty(world, &rect);
+    world->broad_is_stale = true;
+    return 0;
+}
+
+bool world_entity_is_here(struct world_t *world, int i){
+    /* Whether entity i is in the current room */
+    struct entities_t *entities = world->entities;
+    return entities->room_x[i] == world->room_x && entities->room_y[i] == world->room_y;
+}
+
+void world_handle_key(struct world_t *world, SDL_Keycode keycode, bool is_down){
+    /* Updates the key states of whoever (in the current room) has a key
+    bound to keycode */
+    struct entities_t *entities = world->entities;
+    struct keymap_t *keymap = &entities->keymap;
+    for(int b = keymap_get(keymap, keycode); b >= 0; b = keymap->bindings[b].next){
+        struct keymap_binding_t *binding = &keymap->bindings[b];
+        int i = entities_get_i(entities, binding->owner);
+        if(i < 0 || !world_entity_is_here(world, i))continue;
+        if(is_down){
+            entities->key_is_down[i] |= KEY_BIT(binding->key);
+            entities->key_was_down[i] |= KEY_BIT(binding->key);
+        }else{
+            entities->key_is_down[i] &= ~KEY_BIT(binding->key);
+        }
     }
-    if(sprite_i >= world->n_sprites){
-        int new_n_sprites = world->n_sprites * 2;
-        if(new_n_sprites == 0)new_n_sprites = 1;
-        RET_IF_NZ(world_sprites_resize(world, new_n_sprites));
+}
+
+struct entity_bucket_t *world_get_bucket(struct world_t *world){
+    /* Returns the bucket listing entities in the current room */
+    return entities_get_bucket(world->entities, world->room_x, world->room_y);
+}
+
+int world_set_entity_room(struct world_t *world, entity_t entity, int room_x, int room_y){
+    /* Moves entity to another room, keeping its coords within the room */
+    struct entities_t *entities = world->entities;
+    int i = entities_get_i(entities, entity);
+    if(i < 0){
+        LOG("Tried to move a removed entity: %u\n", (unsigned int)entity);
+        return 2;
     }
-    world->sprites[sprite_i] = sprite;
+    SDL_Rect rect;
+    entity_get_rect(entities, i, &rect);
+    if(world_entity_is_here(world, i))world_mark_dirty(world, &rect);
+    RET_IF_NZ(entities_set_room(entities, i, room_x, room_y));
+    if(world_entity_is_here(world, i))world_mark_dirty(world, &rect);
+    world->broad_is_stale = true;
     return 0;
 }
 
+int world_despawn(struct world_t *world, entity_t entity){
+    struct entities_t *entities = world->entities;
+    int i = entities_get_i(entities, entity);
+    if(i >= 0 && world_entity_is_here(world, i)){
+        SDL_Rect rect;
+        entity_get_rect(entities, i, &rect);
+        world_mark_dirty(world, &rect);
+    }
+    world->broad_is_stale = true;
+    return entities_remove(entities, world->map->assets, entity);
+}
+
 void world_repr(struct world_t *world, int depth){
     if(DEBUG_REPR >= 1){
-        LOG(); printf("Dumping world: %p\n", world);
+        LOG("Dumping world: %p\n", world);
     }
 
     REPR_FIELD_MULTI(map, depth)
@@ -88,63 +283,348 @@ void world_repr(struct world_t *world, int depth){
     REPR_FIELD_MULTI(room, depth)
     room_repr(world->room, depth + 1);
 
-    REPR_FIELD_MULTI(sprites, depth)
-    for(int i = 0; i < world->n_sprites; i++){
-        struct sprite_t *sprite = world->sprites[i];
-        if(sprite == NULL){
-            print_tabs(depth + 1);
-            printf("NULL\n");
-        }else{
-            sprite_repr(sprite, depth + 1);
+    REPR_FIELD_MULTI(entities, depth)
+    entities_repr(world->entities, depth + 1);
+
+    REPR_FIELD(world, n_targets, "%i", depth)
+    REPR_FIELD_MULTI(flow, depth)
+    flow_field_repr(&world->flow, depth + 1);
+}
+
+int world_render_framebuffer(struct world_t *world, int world_x, int world_y, SDL_Renderer *renderer){
+    /* Rasterizes the world on the CPU, then draws it with one texture
+    upload & copy */
+    struct room_t *room = world->room;
+    struct pal_t *pal = room->pal;
+    struct entities_t *entities = world->entities;
+    struct entity_bucket_t *bucket = world_get_bucket(world);
+
+    if(world->framebuffer == NULL){
+        world->framebuffer = framebuffer_create(SCW, SCH);
+        if(world->framebuffer == NULL)return 1;
+        world->background = framebuffer_create(SCW, SCH);
+        if(world->background == NULL)return 1;
+        world->dirty_all = true;
+    }
+    struct framebuffer_t *fb = world->framebuffer;
+    struct framebuffer_t *bg = world->background;
+
+    /* Re-rasterize the background if the room (or anything it's drawn
+    from) changed. Versions only ever go up, so their sum changes
+    whenever any of them does. */
+    int version = room->version + room->tileset->version + pal->version;
+    if(world->background_room != room ||
+        world->background_tileset != room->tileset ||
+        world->background_pal != pal ||
+        world->background_version != version
+    ){
+        /* Opaque black */
+        framebuffer_clear(bg, (Uint32)SDL_ALPHA_OPAQUE << 24);
+        room_render_framebuffer(room, 0, 0, bg);
+        world->background_room = room;
+        world->background_tileset = room->tileset;
+        world->background_pal = pal;
+        world->background_version = version;
+        world->dirty_all = true;
+    }
+
+    /* Redraw everything, or just the dirty regions: restore each from the
+    background, then redraw (clipped to it) the sprites which touch it */
+    SDL_Rect all = {0, 0, fb->w, fb->h};
+    SDL_Rect *rects = world->dirty_all? &all: world->dirty;
+    int n_rects = world->dirty_all? 1: world->n_dirty;
+    for(int i = 0; i < n_rects; i++){
+        SDL_Rect *rect = &rects[i];
+        if(!framebuffer_set_clip(fb, rect))continue;
+        framebuffer_copy_rect(fb, bg, rect);
+        for(int j = 0; j < bucket->n; j++){
+            int entity_i = bucket->entity_i[j];
+            SDL_Rect entity_rect;
+            entity_get_rect(entities, entity_i, &entity_rect);
+            if(!SDL_HasIntersection(&entity_rect, &fb->clip))continue;
+            entity_render_framebuffer(entities, entity_i, 0, 0, pal, fb);
         }
     }
+    framebuffer_reset_clip(fb);
+
+    /* The screen itself doesn't persist between frames, so the whole
+    texture is copied to it; but only dirty parts are uploaded */
+    RET_IF_NZ(framebuffer_present(fb, renderer, world_x, world_y,
+        world->dirty_all? NULL: world->dirty, world->n_dirty));
+    world->dirty_all = false;
+    world->n_dirty = 0;
+    return 0;
 }
 
 int world_render(struct world_t *world, int world_x, int world_y, SDL_Renderer *renderer){
     if(DEBUG_RENDER >= 1){
-        LOG(); printf("Rendering world: %p\n", world);
+        LOG("Rendering world: %p\n", world);
     }
 
     struct room_t *room = world->room;
     struct pal_t *pal = room->pal;
+    struct draw_batch_t *batch = world->batch;
 
-    RET_IF_NZ(room_render(world->room, world_x, world_y, renderer));
+    if(world->render_mode == RENDER_MODE_FRAMEBUFFER){
+        return world_render_framebuffer(world, world_x, world_y, renderer);
+    }
 
-    for(int i = 0; i < world->n_sprites; i++){
-        struct sprite_t *sprite = world->sprites[i];
-        if(sprite != NULL){
-            RET_IF_NZ(sprite_render(sprite, world_x, world_y, pal, renderer));
-        }
+    batch->force_rects = world->render_mode == RENDER_MODE_RECTS;
+    if(world->render_mode == RENDER_MODE_RECTS){
+        RET_IF_NZ(room_render(room, world_x, world_y, renderer, batch));
+    }else{
+        RET_IF_NZ(room_render_layer(room, world_x, world_y, renderer, batch));
     }
 
+    struct entities_t *entities = world->entities;
+    struct entity_bucket_t *bucket = world_get_bucket(world);
+    for(int i = 0; i < bucket->n; i++){
+        RET_IF_NZ(entity_render(entities, bucket->entity_i[i], world_x, world_y, pal, renderer, batch));
+    }
+
+    RET_IF_NZ(draw_batch_flush(batch, renderer));
     return 0;
 }
 
 int world_prepare_tick(struct world_t *world){
-    for(int i = 0; i < world->n_sprites; i++){
-        struct sprite_t *sprite = world->sprites[i];
-        if(sprite != NULL){
-            struct controller_t *controller = &sprite->controller;
-            for(int j = 0; j < KEYS; j++){
-                controller->key_was_down[j] = controller->key_is_down[j];
+    /* Pick up any rooms which finished loading in the background */
+    map_poll_prefetch(world->map);
+
+    struct entities_t *entities = world->entities;
+    if(entities->n > 0)memcpy(entities->key_was_down, entities->key_is_down, entities->n);
+    return 0;
+}
+
+struct broad_t *world_get_broad(struct world_t *world){
+    /* Returns world->broad, first rebuilding it from the current room's
+    entities if it's stale. Built on demand, so ticks where nobody asks
+    for it don't pay for it. */
+    if(world->broad_is_stale){
+        struct room_t *room = world->room;
+        struct entity_bucket_t *bucket = world_get_bucket(world);
+        RET_NULL_IF_NZ(broad_build(world->broad, world->entities, bucket->entity_i, bucket->n,
+            room->w * room->tileset->tile_w * TILE_PIXEL_W,
+            room->h * room->tileset->tile_h * TILE_PIXEL_H));
+        world->broad_is_stale = false;
+    }
+    return world->broad;
+}
+
+int world_get_entity_tile(struct world_t *world, int i, int *tile_x, int *tile_y){
+    /* Returns the index of the current room's tile under the middle of
+    entity i (setting tile_x, tile_y to its coords), or -1 if that's
+    outside the room */
+    struct room_t *room = world->room;
+    SDL_Rect rect;
+    entity_get_rect(world->entities, i, &rect);
+    int x = INT_QUO(rect.x + rect.w / 2, room->tileset->tile_w * TILE_PIXEL_W);
+    int y = INT_QUO(rect.y + rect.h / 2, room->tileset->tile_h * TILE_PIXEL_H);
+    if(x < 0 || y < 0 || x >= room->w || y >= room->h)return -1;
+    *tile_x = x;
+    *tile_y = y;
+    return y * room->w + x;
+}
+
+int world_update_flow(struct world_t *world){
+    /* Points world->flow at the tiles of those targets which are in the
+    current room, dropping removed targets along the way. Costs nothing
+    much unless they moved to other tiles, see flow_field_update. */
+    struct entities_t *entities = world->entities;
+    int n_tiles = 0;
+    int n_targets = 0;
+    for(int k = 0; k < world->n_targets; k++){
+        entity_t entity = world->targets[k];
+        int i = entities_get_i(entities, entity);
+        if(i < 0)continue;
+        world->targets[n_targets++] = entity;
+        if(!world_entity_is_here(world, i))continue;
+        int tile_x, tile_y;
+        int tile_i = world_get_entity_tile(world, i, &tile_x, &tile_y);
+        if(tile_i >= 0)world->target_tiles[n_tiles++] = tile_i;
+    }
+    world->n_targets = n_targets;
+    return flow_field_update(&world->flow, world->room, world->target_tiles, n_tiles);
+}
+
+Uint8 world_get_chase_keys(struct world_t *world, int i){
+    /* The keys which take entity i (in the current room) a step along the
+    flow field. Moving between tiles, it also heads for the middle of the
+    row or column it's in, so it doesn't catch on corners. */
+    struct room_t *room = world->room;
+    int tile_x, tile_y;
+    int tile_i = world_get_entity_tile(world, i, &tile_x, &tile_y);
+    if(tile_i < 0)return 0;
+    Uint8 keys = flow_field_get_step(&world->flow, tile_i);
+    if(keys == 0)return 0;
+
+    SDL_Rect rect;
+    entity_get_rect(world->entities, i, &rect);
+    int cell_w = room->tileset->tile_w * TILE_PIXEL_W;
+    int cell_h = room->tileset->tile_h * TILE_PIXEL_H;
+    if(keys & (KEY_BIT(KEY_U) | KEY_BIT(KEY_D))){
+        int dx = tile_x * cell_w + cell_w / 2 - (rect.x + rect.w / 2);
+        if(dx < 0)keys |= KEY_BIT(KEY_L);
+        if(dx > 0)keys |= KEY_BIT(KEY_R);
+    }else{
+        int dy = tile_y * cell_h + cell_h / 2 - (rect.y + rect.h / 2);
+        if(dy < 0)keys |= KEY_BIT(KEY_U);
+        if(dy > 0)keys |= KEY_BIT(KEY_D);
+    }
+    return keys;
+}
+
+int world_use_jobs(struct world_t *world, int n_threads){
+    /* Spreads ticks over n_threads worker threads (0 for one per core, -1
+    for none). The world has a pool of its own, since assets' may be busy
+    loading rooms in the background. */
+    if(n_threads < 0)return 0;
+    struct job_pool_t *jobs = job_pool_create(n_threads);
+    if(jobs == NULL)return 2;
+    world->jobs = jobs;
+    return 0;
+}
+
+int world_reserve_tick(struct world_t *world, int cap){
+    /* Makes room for cap entities in the arrays used during ticks */
+    if(cap <= world->tick_cap)return 0;
+    Uint8 *tick_keys = realloc(world->tick_keys, sizeof(*tick_keys) * cap);
+    if(tick_keys == NULL)return 1;
+    world->tick_keys = tick_keys;
+    int *next_x = realloc(world->next_x, sizeof(*next_x) * cap);
+    if(next_x == NULL)return 1;
+    world->next_x = next_x;
+    int *next_y = realloc(world->next_y, sizeof(*next_y) * cap);
+    if(next_y == NULL)return 1;
+    world->next_y = next_y;
+    world->tick_cap = cap;
+    return 0;
+}
+
+void world_tick_input(struct world_t *world, int start, int end){
+    /* Phase 1: the keys each of entities start .. end-1 acts on. CPU
+    entities in the current room chase targets (see world_update_flow);
+    their own keys only count elsewhere. */
+    struct entities_t *entities = world->entities;
+    for(int i = start; i < end; i++){
+        if(entities->controller[i].is_cpu && world_entity_is_here(world, i)){
+            world->tick_keys[i] = world_get_chase_keys(world, i);
+        }else{
+            world->tick_keys[i] = entities->key_was_down[i];
+        }
+    }
+}
+
+void world_tick_integrate(struct world_t *world, int start, int end){
+    /* Phase 2: where each is headed */
+    struct entities_t *entities = world->entities;
+    for(int i = start; i < end; i++){
+        Uint8 keys = world->tick_keys[i];
+        int x = entities->x[i];
+        int y = entities->y[i];
+        if(keys & KEY_BIT(KEY_U))y -= 1;
+        if(keys & KEY_BIT(KEY_D))y += 1;
+        if(keys & KEY_BIT(KEY_L))x -= 1;
+        if(keys & KEY_BIT(KEY_R))x += 1;
+        world->next_x[i] = x;
+        world->next_y[i] = y;
+    }
+}
+
+void world_tick_interact(struct world_t *world, int start, int end){
+    /* Phase 3: moves into the current room's walls are blocked, sliding
+    along them if moving diagonally. Only the current room is sure to be
+    loaded, so entities elsewhere go wherever they like; and so do those
+    already in a wall (e.g. spawned there), so they can get out. */
+    struct entities_t *entities = world->entities;
+    struct room_t *room = world->room;
+    for(int i = start; i < end; i++){
+        if(!world_entity_is_here(world, i))continue;
+        int x = entities->x[i];
+        int y = entities->y[i];
+        int next_x = world->next_x[i];
+        int next_y = world->next_y[i];
+        if(next_x == x && next_y == y)continue;
+        if(!collide_entity_room_at(entities, i, next_x, next_y, room))continue;
+        if(collide_entity_room_at(entities, i, x, y, room))continue;
+        if(next_x != x && next_y != y){
+            if(!collide_entity_room_at(entities, i, next_x, y, room)){
+                world->next_y[i] = y;
+                continue;
+            }
+            if(!collide_entity_room_at(entities, i, x, next_y, room)){
+                world->next_x[i] = x;
+                continue;
             }
         }
+        world->next_x[i] = x;
+        world->next_y[i] = y;
     }
+}
+
+void world_tick_commit(struct world_t *world, int start, int end){
+    /* Phase 4: entities move to where they're headed */
+    struct entities_t *entities = world->entities;
+    memcpy(entities->x + start, world->next_x + start, sizeof(*entities->x) * (end - start));
+    memcpy(entities->y + start, world->next_y + start, sizeof(*entities->y) * (end - start));
+}
+
+int world_tick_move_job(void *data, int chunk){
+    /* Phases 1-3 for a chunk of entities: no entity's outcome depends on
+    any other's, so there's no need to wait for one phase to finish
+    everywhere before starting the next */
+    struct world_t *world = data;
+    int start = chunk * TICK_CHUNK_SIZE;
+    int end = INT_MIN(start + TICK_CHUNK_SIZE, world->entities->n);
+    world_tick_input(world, start, end);
+    world_tick_integrate(world, start, end);
+    world_tick_interact(world, start, end);
+    return 0;
+}
+
+int world_tick_commit_job(void *data, int chunk){
+    struct world_t *world = data;
+    int start = chunk * TICK_CHUNK_SIZE;
+    int end = INT_MIN(start + TICK_CHUNK_SIZE, world->entities->n);
+    world_tick_commit(world, start, end);
     return 0;
 }
 
 int world_do_tick(struct world_t *world){
-    for(int i = 0; i < world->n_sprites; i++){
-        struct sprite_t *sprite = world->sprites[i];
-        if(sprite != NULL){
-            struct controller_t *controller = &sprite->controller;
-            controller_repr(controller, 1);
-            if(controller->key_was_down[KEY_U])sprite->y -= 1;
-            if(controller->key_was_down[KEY_D])sprite->y += 1;
-            if(controller->key_was_down[KEY_L])sprite->x -= 1;
-            if(controller->key_was_down[KEY_R])sprite->x += 1;
-        }
+    /*
+        Moves every entity according to its keys, in phases (see
+        world_tick_input etc.) run over chunks of TICK_CHUNK_SIZE entities,
+        on world->jobs if there is one. Each entity only writes to its own
+        slots of the tick arrays, and only reads its own state, the
+        (unchanging) room & flow field, so the outcome is the same
+        whatever order the chunks run in, on however many threads.
+    */
+    struct entities_t *entities = world->entities;
+    if(DEBUG_TICK >= 1){
+        for(int i = 0; i < entities->n; i++)entity_repr(entities, i, 1);
     }
+    RET_IF_NZ(world_reserve_tick(world, entities->cap));
+    RET_IF_NZ(world_update_flow(world));
+    int n_chunks = (entities->n + TICK_CHUNK_SIZE - 1) / TICK_CHUNK_SIZE;
+    RET_IF_NZ(job_pool_run(world->jobs, world_tick_move_job, world, n_chunks));
+
+    /* Whatever moves in the current room needs redrawing, both where it
+    was & where it is now. The bucket's order is the same whatever the
+    number of threads, so the dirty rects are too. Once everything's
+    dirty, there's nothing left to mark. */
+    struct entity_bucket_t *bucket = world_get_bucket(world);
+    for(int k = 0; k < bucket->n && !world->dirty_all; k++){
+        int i = bucket->entity_i[k];
+        if(world->next_x[i] == entities->x[i] && world->next_y[i] == entities->y[i])continue;
+        SDL_Rect old_rect;
+        entity_get_rect(entities, i, &old_rect);
+        SDL_Rect new_rect = old_rect;
+        new_rect.x = world->next_x[i];
+        new_rect.y = world->next_y[i];
+        world_mark_dirty_moved(world, &old_rect, &new_rect);
+    }
+
+    RET_IF_NZ(job_pool_run(world->jobs, world_tick_commit_job, world, n_chunks));
+    world->broad_is_stale = true;
     return 0;
 }
 
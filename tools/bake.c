@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "util.h"
+#include "settings.h"
+#include "map.h"
+#include "sprite.h"
+#include "world.h"
+#include "scene.h"
+#include "assets.h"
+#include "pack.h"
+
+
+/*
+    Asset baker: loads maps, sprites & scenes from their text formats, and
+    writes them, along with every room, tileset & pal they use, to a pack
+    (see pack.h). When the game finds a pack, it loads from that instead
+    of the text files.
+
+    Usage: tool_bake PACK_FNAME (map|sprite|scene) FNAME [...]
+    e.g.: tool_bake data/pack.bin map data/map0.txt sprite data/sprites/player.txt
+
+    Scenes themselves aren't baked (they're tiny), but their map and
+    sprites are.
+*/
+
+
+#define BAKE_MAX_ENTRIES 4096
+
+struct bake_t {
+    /* everything gets loaded through here, from text */
+    struct assets_t *assets;
+
+    struct pack_writer_t writer;
+
+    /* entry table, written last */
+    int n_entries;
+    struct pack_entry_t entries[BAKE_MAX_ENTRIES];
+};
+
+
+bool bake_has_entry(struct bake_t *bake, int type, const char *path){
+    for(int i = 0; i < bake->n_entries; i++){
+        struct pack_entry_t *entry = &bake->entries[i];
+        if(entry->type == (Uint32)type && strcmp((const char *)bake->writer.data + entry->path, path) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+int bake_begin_entry(struct bake_t *bake, int type, const char *path, struct pack_entry_t **entry_ptr){
+    /* Starts a new entry, whose data is whatever gets written between this
+    and bake_end_entry. So any strings it refers to must be written first. */
+    if(bake->n_entries >= BAKE_MAX_ENTRIES){
+        LOG("Too many entries: max=%i\n", BAKE_MAX_ENTRIES);
+        return 2;
+    }
+    struct pack_entry_t *entry = &bake->entries[bake->n_entries++];
+    entry->type = type;
+    RET_IF_NZ(pack_write_string(&bake->writer, path, &entry->path));
+    entry->offset = bake->writer.size;
+    *entry_ptr = entry;
+    return 0;
+}
+
+void bake_end_entry(struct bake_t *bake, struct pack_entry_t *entry){
+    entry->size = bake->writer.size - entry->offset;
+}
+
+int bake_pal(struct bake_t *bake, const char *path, struct pal_t *pal){
+    struct pack_writer_t *writer = &bake->writer;
+    Uint32 name;
+    RET_IF_NZ(pack_write_string(writer, pal->name, &name));
+
+    struct pack_entry_t *entry;
+    RET_IF_NZ(bake_begin_entry(bake, ASSET_PAL, path, &entry));
+    RET_IF_NZ(pack_write_i32(writer, name));
+    RET_IF_NZ(pack_write_i32(writer, pal->len));
+    for(int i = 0; i < pal->len; i++){
+        SDL_Color *c = &pal->colors[i];
+        Uint8 rgba[4] = {c->r, c->g, c->b, c->a};
+        RET_IF_NZ(pack_write_bytes(writer, rgba, 4));
+    }
+    bake_end_entry(bake, entry);
+    return 0;
+}
+
+int bake_tileset(struct bake_t *bake, const char *path, struct tileset_t *tileset){
+    struct pack_writer_t *writer = &bake->writer;
+    Uint32 name;
+    RET_IF_NZ(pack_write_string(writer, tileset->name, &name));
+
+    struct pack_entry_t *entry;
+    RET_IF_NZ(bake_begin_entry(bake, ASSET_TILESET, path, &entry));
+    RET_IF_NZ(pack_write_i32(writer, name));
+    RET_IF_NZ(pack_write_i32(writer, tileset->tile_w));
+    RET_IF_NZ(pack_write_i32(writer, tileset->tile_h));
+    RET_IF_NZ(pack_write_i32(writer, tileset->len));
+    for(int i = 0; i < tileset->len; i++){
+        struct tile_t *tile = &tileset->tiles[i];
+        int size = tileset->tile_w * tileset->tile_h;
+        RET_IF_NZ(pack_write_bytes(writer, tile->pixels, (size + 1) / 2));
+        RET_IF_NZ(pack_write_bytes(writer, tile->mask, (size + 7) / 8));
+    }
+    bake_end_entry(bake, entry);
+    return 0;
+}
+
+int bake_room(struct bake_t *bake, const char *path, struct room_t *room){
+    /* room's tileset & pal were acquired through the registry, so their
+    fnames are the canonical paths they get baked under */
+    struct pack_writer_t *writer = &bake->writer;
+    Uint32 name, tileset_fname, pal_fname;
+    RET_IF_NZ(pack_write_string(writer, room->name, &name));
+    RET_IF_NZ(pack_write_string(writer, room->tileset == NULL? NULL: room->tileset->fname, &tileset_fname));
+    RET_IF_NZ(pack_write_string(writer, room->pal == NULL? NULL: room->pal->fname, &pal_fname));
+
+    struct pack_entry_t *entry;
+    RET_IF_NZ(bake_begin_entry(bake, ASSET_ROOM, path, &entry));
+    RET_IF_NZ(pack_write_i32(writer, name));
+    RET_IF_NZ(pack_write_i32(writer, tileset_fname));
+    RET_IF_NZ(pack_write_i32(writer, pal_fname));
+    RET_IF_NZ(pack_write_i32(writer, room->offset_n));
+    RET_IF_NZ(pack_write_i32(writer, room->offset_s));
+    RET_IF_NZ(pack_write_i32(writer, room->offset_e));
+    RET_IF_NZ(pack_write_i32(writer, room->offset_w));
+    RET_IF_NZ(pack_write_i32(writer, room->w));
+    RET_IF_NZ(pack_write_i32(writer, room->h));
+    RET_IF_NZ(pack_write_grid(writer, &room->data));
+    bake_end_entry(bake, entry);
+    return 0;
+}
+
+int bake_map(struct bake_t *bake, struct map_t *map){
+    struct pack_writer_t *writer = &bake->writer;
+    char *path = assets_canonical_path(map->fname);
+    if(path == NULL)return 1;
+    if(bake_has_entry(bake, ASSET_MAP, path)){
+        free(path);
+        return 0;
+    }
+
+    /* Maps load their rooms lazily, but we want to bake them all (see
+    bake_assets) */
+    RET_IF_NZ(map_load_all_rooms(map));
+
+    Uint32 name;
+    RET_IF_NZ(pack_write_string(writer, map->name, &name));
+    Uint32 *room_fnames = malloc(sizeof(*room_fnames) * (map->len + 1));
+    if(room_fnames == NULL)return 1;
+    for(int i = 0; i < map->len; i++){
+        RET_IF_NZ(pack_write_string(writer, map->rooms[i]->fname, &room_fnames[i]));
+    }
+
+    struct pack_entry_t *entry;
+    RET_IF_NZ(bake_begin_entry(bake, ASSET_MAP, path, &entry));
+    RET_IF_NZ(pack_write_i32(writer, name));
+    RET_IF_NZ(pack_write_i32(writer, map->len));
+    RET_IF_NZ(pack_write_i32(writer, map->w));
+    RET_IF_NZ(pack_write_i32(writer, map->h));
+    RET_IF_NZ(pack_write_i32(writer, map->entrance_x));
+    RET_IF_NZ(pack_write_i32(writer, map->entrance_y));
+    for(int i = 0; i < map->len; i++){
+        RET_IF_NZ(pack_write_i32(writer, room_fnames[i]));
+    }
+    RET_IF_NZ(pack_write_grid(writer, &map->data));
+    bake_end_entry(bake, entry);
+
+    free(room_fnames);
+    free(path);
+    return 0;
+}
+
+int bake_sprite(struct bake_t *bake, struct sprite_t *sprite){
+    struct pack_writer_t *writer = &bake->writer;
+    char *path = assets_canonical_path(sprite->fname);
+    if(path == NULL)return 1;
+    if(bake_has_entry(bake, ASSET_SPRITE, path)){
+        free(path);
+        return 0;
+    }
+
+    Uint32 name, tileset_fname;
+    RET_IF_NZ(pack_write_string(writer, sprite->name, &name));
+    RET_IF_NZ(pack_write_string(writer, sprite->tileset == NULL? NULL: sprite->tileset->fname, &tileset_fname));
+
+    struct pack_entry_t *entry;
+    RET_IF_NZ(bake_begin_entry(bake, ASSET_SPRITE, path, &entry));
+    RET_IF_NZ(pack_write_i32(writer, name));
+    RET_IF_NZ(pack_write_i32(writer, tileset_fname));
+    bake_end_entry(bake, entry);
+
+    free(path);
+    return 0;
+}
+
+int bake_assets(struct bake_t *bake){
+    /* Bakes everything the maps & sprites acquired through the registry */
+    for(struct asset_t *asset = bake->assets->assets; asset != NULL; asset = asset->next){
+        switch(asset->type){
+            case ASSET_PAL: RET_IF_NZ(bake_pal(bake, asset->path, asset->data)); break;
+            case ASSET_TILESET: RET_IF_NZ(bake_tileset(bake, asset->path, asset->data)); break;
+            case ASSET_ROOM: RET_IF_NZ(bake_room(bake, asset->path, asset->data)); break;
+            default:
+                LOG("Unexpected asset type: %i\n", asset->type);
+                return 2;
+        }
+    }
+    return 0;
+}
+
+int bake_load(struct bake_t *bake, const char *kind, const char *fname){
+    /* Loads fname from text, baking it (unless it's a scene, in which case
+    its map & sprites) */
+    struct assets_t *assets = bake->assets;
+    if(strcmp(kind, "map") == 0){
+        struct map_t *map = map_load(assets, fname);
+        if(map == NULL)return 2;
+        RET_IF_NZ(bake_map(bake, map));
+    }else if(strcmp(kind, "sprite") == 0){
+        struct sprite_t *sprite = sprite_load(assets, fname);
+        if(sprite == NULL)return 2;
+        RET_IF_NZ(bake_sprite(bake, sprite));
+    }else if(strcmp(kind, "scene") == 0){
+        struct world_t *world = scene_load(assets, fname);
+        if(world == NULL)return 2;
+        RET_IF_NZ(bake_map(bake, world->map));
+        struct entities_t *entities = world->entities;
+        for(int i = 0; i < entities->n; i++){
+            /* What the entity was spawned from */
+            struct sprite_t sprite = {entities->name[i], entities->fname[i], entities->tileset[i]};
+            RET_IF_NZ(bake_sprite(bake, &sprite));
+        }
+    }else{
+        LOG("Expected \"map\", \"sprite\" or \"scene\", got: %s\n", kind);
+        return 2;
+    }
+    return 0;
+}
+
+int bake_write(struct bake_t *bake, const char *pack_fname){
+    /* Finishes the pack (entry table & header) and writes it out */
+    struct pack_writer_t *writer = &bake->writer;
+    Uint32 entries_offset = writer->size;
+    for(int i = 0; i < bake->n_entries; i++){
+        struct pack_entry_t *entry = &bake->entries[i];
+        RET_IF_NZ(pack_write_i32(writer, entry->type));
+        RET_IF_NZ(pack_write_i32(writer, entry->path));
+        RET_IF_NZ(pack_write_i32(writer, entry->offset));
+        RET_IF_NZ(pack_write_i32(writer, entry->size));
+    }
+
+    Uint8 *header = writer->data;
+    memcpy(header, PACK_MAGIC, 4);
+    pack_encode_u32(header + 4, PACK_VERSION);
+    pack_encode_u32(header + 8, bake->n_entries);
+    pack_encode_u32(header + 12, entries_offset);
+
+    FILE *f = fopen(pack_fname, "wb");
+    if(f == NULL){
+        LOG("Could not open file for writing: %s\n", pack_fname);
+        return 2;
+    }
+    size_t n_written_bytes = fwrite(writer->data, 1, writer->size, f);
+    if(fclose(f) != 0 || n_written_bytes != writer->size){
+        LOG("Could not write file: %s\n", pack_fname);
+        return 2;
+    }
+    return 0;
+}
+
+int bake(const char *pack_fname, int n_fnames, char *fnames[]){
+    struct bake_t *bake = malloc(sizeof(*bake));
+    if(bake == NULL)return 1;
+    bake->assets = assets_create();
+    if(bake->assets == NULL)return 1;
+    bake->n_entries = 0;
+    pack_writer_init(&bake->writer);
+
+    /* Header gets filled in by bake_write */
+    Uint8 header[PACK_HEADER_SIZE] = {0};
+    RET_IF_NZ(pack_write_bytes(&bake->writer, header, PACK_HEADER_SIZE));
+
+    for(int i = 0; i + 1 < n_fnames; i += 2){
+        RET_IF_NZ(bake_load(bake, fnames[i], fnames[i + 1]));
+    }
+    RET_IF_NZ(bake_assets(bake));
+    RET_IF_NZ(bake_write(bake, pack_fname));
+
+    fprintf(stderr, "Baked %i entries (%u bytes) into %s\n", bake->n_entries, bake->writer.size, pack_fname);
+    return 0;
+}
+
+int main(int n_args, char *args[]){
+    if(n_args < 4 || (n_args - 2) % 2 != 0){
+        fprintf(stderr, "Usage: %s PACK_FNAME (map|sprite|scene) FNAME [...]\n", args[0]);
+        return 2;
+    }
+    log_start();
+    int e = bake(args[1], n_args - 2, args + 2);
+    log_stop();
+    fprintf(stderr, "Exiting with code: %i\n", e);
+    return e;
+}